@@ -4,16 +4,22 @@
 #include <fstream>
 #include <vector>
 #include "parser.h"
+#include "expression.h"
+#include "../../common/inc/stats.h"
 
 using namespace std;
 
+class ObjectCache;
+
 class Assembler {
 private:
     string inputFile;
     string outputFile;
+    string includeDir;  // .incbin paths are relative to it, the directory of inputFile by default
 
-    ifstream& inputStream;
-    ofstream& outputStream;
+    ifstream inputStream;
+    ofstream outputStream;
+    ostream& log;   // errors and progress, one per instance so files can be assembled in parallel
 
     vector<string> lines;
 
@@ -22,56 +28,111 @@ private:
     size_t lineNum = 0;
     size_t position= 0;
     string currentSection = "UNDEFINED";
+    unsigned jobs = 1;  // threads for the second pass
+    bool optimize = false;  // run the peephole pass
+    bool listing = true;    // write the text listing next to the object
+    Stats* stats = nullptr; // phases and counts of the run when set
+    ObjectCache* cache = nullptr;
 
     struct SymbolEntry {
         string name;
         string section;
-        int value;
-        bool isDefined;
-        bool isGlobal;
-        bool isExtern;
+        int value = 0;
+        bool isDefined = false;
+        bool isGlobal = false;
+        bool isExtern = false;
     };
 
     struct SectionEntry {
         string name;
-        size_t size;
+        size_t size = 0;
         vector<char> data;
         vector<size_t> offsets;
+        bool nobits = false;    // .section name,nobits: only the size is kept, the loader zero fills it
     };
 
     struct RelocationEntry {
         string section;
-        size_t size;
-        int offset;
+        size_t size = 0;
+        int offset = 0;
         string type;
         string symbolName;
-        bool isData;
+        bool isData = false;
+        size_t line = 0;    // source line, orders relocations from different sections
+    };
+
+    // second pass over one section, sections are encoded in parallel and merged
+    struct SectionPass {
+        string section;
+        bool nobits = false;
+        vector<size_t> lines;   // indexes into lines, in source order
+        size_t line = 0;        // the one being encoded
+        size_t position = 0;
+        vector<char> data;
+        vector<size_t> offsets;
+        vector<RelocationEntry> relocations;
+        vector<string> missing; // symbols used but not in the symbol table
+        vector<string> errors;  // logged after the merge, passes don't share the log
+
+        void relocate(RelocationEntry re) {
+            re.line = line;
+            relocations.push_back(re);
+        }
+    };
+
+    // .incbin "file"[,offset,length], sized in the first pass and read straight
+    // into the section in the second
+    struct Blob {
+        string file;
+        size_t offset = 0;
+        size_t length = 0;
     };
 
     map<string, SymbolEntry> symbolTable;
     map<string, SectionEntry> sectionTable;
     vector<RelocationEntry> relocationTable;
+    map<size_t, Blob> blobs;    // by index into lines
 
-    bool firstPass();
+    bool firstPass(istream& in);
     bool secondPass();
+    void secondPass(SectionPass& pass);
+    const SymbolEntry& lookupSymbol(const string& name, SectionPass& pass);
     bool handleWordFirstPass();
-    bool handleWordSecondPass(const string& arg);
+    bool handleWordSecondPass(const string& arg, SectionPass& pass);
     bool handleGlobal(const string& symb);
     bool handleEqu(const string& symb, const string& val);
     bool handleExtern(const string& symb);
     bool handleSkipFirstPass(const string& value);
-    bool handleSkipSecondPass(const int& len);
-    bool handleSection(const string& section);
+    bool handleSkipSecondPass(const int& len, SectionPass& pass);
+    bool handleSection(const string& arg);   // name[,nobits]
+    bool handleIncbinFirstPass(const string& args);
+    bool handleIncbinSecondPass(const Blob& blob, SectionPass& pass);
+    string blobStamps(const string& source);
+    string includePath(const string& file);
     bool handleLabel(const string& label);
     bool handleInstructionFirstPass(const string& line);
-    bool handleInstructionSecondPass(const string& line);
-    int handleAbsoluteSymbol(const string& symbol);
-    int handlePcRelSymbol(const string& symbol);
+    bool handleInstructionSecondPass(const string& line, SectionPass& pass);
+    int handleExpression(const string& expr, SectionPass& pass, bool isData, bool pcRel);
+    bool evaluate(const string& expr, Expression::Value& result, SectionPass* pass);
+    int operandMode(const string& oprnd, bool isJump);
     void createTxt(ostream& out);
-    void createBin(ofstream& out);
+    void createBin(ostream& out);
+    string binaryFile();
 public:
-    Assembler(const string& inputFile, const string& outputFile);
+    static const string version;
+
+    Assembler(const string& inputFile = "", const string& outputFile = "", ostream& log = cout);
     bool assemble();
+    bool assembleSource(istream& in);   // both passes, no files touched
+    void reset();
+    void setJobs(unsigned jobs) { this->jobs = max(1u, jobs); }
+    void setCache(ObjectCache* cache) { this->cache = cache; }
+    void setOptimize(bool optimize) { this->optimize = optimize; }
+    void setListing(bool listing) { this->listing = listing; }
+    void setStats(Stats* stats) { this->stats = stats; }
+    void setIncludeDir(const string& dir) { includeDir = dir.empty() || dir.back() == '/' ? dir : dir + "/"; }
+    void writeObject(ostream& out);
+    void writeListing(ostream& out);
 };
 
 #endif //ASSEMBLER_H
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+#include <string>
+#include <functional>
+
+using namespace std;
+
+// Constant expressions in operands and directives: numbers, symbols, parentheses,
+// unary - ~, * + - << >> & ^ | with C precedence. Symbols resolve to either an
+// absolute value or an offset from a base (a section or an external symbol) that
+// the linker fills in; a difference of two values with the same base folds to an
+// absolute one, anything else done to a relocatable value is an error.
+class Expression {
+public:
+    struct Value {
+        int value = 0;
+        string base;    // empty for absolute values
+
+        bool isAbsolute() const { return base.empty(); }
+    };
+
+    // false when the symbol can't be used here, the error is set by the resolver
+    using Resolver = function<bool(const string& symbol, Value& value, string& error)>;
+
+    Expression(Resolver resolve) : resolve(resolve) {}
+
+    bool evaluate(const string& text, Value& result);
+    const string& getError() { return error; }
+
+private:
+    Resolver resolve;
+    string text;
+    size_t pos = 0;
+    string error;
+
+    void skipSpaces();
+    bool accept(const string& op);
+    bool fail(const string& message);
+    bool absolute(const Value& a, const Value& b, const string& op);
+
+    bool parseOr(Value& v);
+    bool parseXor(Value& v);
+    bool parseAnd(Value& v);
+    bool parseShift(Value& v);
+    bool parseAdd(Value& v);
+    bool parseMul(Value& v);
+    bool parseUnary(Value& v);
+    bool parsePrimary(Value& v);
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef OBJECTCACHE_H
+#define OBJECTCACHE_H
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+// On disk cache of assembled objects, keyed by a hash of everything that goes into
+// them. An entry holds both outputs and is written to a temporary file and renamed,
+// so concurrent builds never see half of one.
+class ObjectCache {
+private:
+    string dir;
+    uintmax_t maxBytes;
+
+    string entryPath(const string& key) { return dir + "/" + key + ".obj"; }
+
+public:
+    ObjectCache(const string& dir, uintmax_t maxBytes) : dir(dir), maxBytes(maxBytes) {}
+
+    bool open();    // creates the directory
+    string key(const string& source, const string& options);
+    bool restore(const string& key, const string& objectFile, const string& binaryFile);    // objectFile may be empty
+    bool store(const string& key, const string& object, const string& binary);
+    void evict();   // drops the least recently used entries until under maxBytes
+
+    static bool writeAtomic(const string& file, const string& data);
+};
+
+#endif
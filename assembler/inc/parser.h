@@ -2,6 +2,7 @@
 #define PARSER_H
 #include <string>
 #include <regex>
+#include "../../common/inc/isa.h"
 
 using namespace std;
 
@@ -10,12 +11,14 @@ private:
     void removeComments(string& line);
     void removeExtraSpaces(string& line);
 
-    string literal = "(-?[0-9]+)|(0x[0-9A-F]+)";
-    string symbol = "[a-zA-Z][a-zA-Z0-9_]*";
-    string registerRange = "[0-7]";
+    // shared by every instance, the regexes built from them are compiled once
+    static const string literal;
+    static const string symbol;
+    static const string registerRange;
 
     // combined helper strings
-    string symbolOrLiteral = symbol + "|" + literal;
+    static const string symbolOrLiteral;
+    static const string expression; // symbols and literals joined by operators, checked by Expression
 
 public:
     string clearLine(string line);
@@ -31,6 +34,7 @@ public:
     bool isDirective(const string& line);
     bool noOperInstr(const string& instr);
     bool isSymbol(const string& symb);
+    const isa::Instruction* getInstruction(const string& instr);    // nullptr for unknown mnemonics
 
     //Operands
     bool oneOperRegInstr(const string& instr);
@@ -49,6 +53,7 @@ public:
     bool regIndDispAddress(const string& oprnd);
 
     string getSymOrLit(const string& oprnd);
+    string getExpression(const string& oprnd);  // without $, % or the [reg + ...] around it
     int getReg(const string& oprnd);
 };
 #endif //PARSER_H
\ No newline at end of file
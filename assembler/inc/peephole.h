@@ -0,0 +1,41 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+#include <string>
+#include <vector>
+#include <map>
+#include "parser.h"
+
+using namespace std;
+
+// Opt-in peephole pass over the cleaned source of a file. It runs before the first
+// pass, so sizes, label values and relocations all come out of the normal passes
+// and stay consistent with the code that is actually emitted. Removed statements
+// leave their labels and an empty line behind, line numbers don't move.
+class Peephole {
+private:
+    struct Line {
+        string label;
+        string stmt;    // empty when the line is only a label or was removed
+    };
+
+    Parser& parser;
+    vector<Line> code;
+    map<string, size_t> labels;     // label -> line
+
+    size_t next(size_t i);  // first line after i with a statement, code.size() if none
+    bool endsFlow(const string& stmt);
+    bool isConstantZero(const string& expr);
+    string jumpTarget(const string& operand);
+
+    int removeUnreachable();
+    int removePushPop();
+    int foldJumps();
+    int shortenOperands();
+
+public:
+    Peephole(Parser& parser) : parser(parser) {}
+
+    int optimize(vector<string>& lines);    // returns the number of changes made
+};
+
+#endif
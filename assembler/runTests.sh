@@ -0,0 +1,33 @@
+# Assembles the samples in test/ and checks them against test/expected/. Listings are
+# compared as they are, programs are linked and what they print is compared.
+make
+(cd ../linker && make)
+(cd ../emulator && mkdir -p bin && make)
+
+here=$(pwd)
+out=$(mktemp -d)
+failed=0
+
+check() {  # output name
+    if cmp -s $1 test/expected/$2.txt; then echo "ok   $2"; else echo "FAIL $2"; failed=1; fi
+}
+
+listing() {  # name [assembler options]
+    ./assembler "${@:2}" -o $out/$1.o test/$1.s > /dev/null
+    check $out/$1.o $1
+}
+
+run() {  # name
+    ./assembler -o $out/$1.o test/$1.s > /dev/null
+    (cd $out && $here/../linker/linker -hex -place=ivt@0x0000 -o $1.hex bin_$1.o)
+    ../emulator/emulator $out/bin_$1.hex < /dev/null > $out/$1.out
+    check $out/$1.out $1
+}
+
+run flags
+run irq
+listing expr
+listing peephole -O
+
+rm -rf $out
+exit $failed
@@ -1,48 +1,147 @@
 #include <iomanip>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <sstream>
+#include <regex>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "../inc/assembler.h"
+#include "../inc/objectcache.h"
+#include "../inc/peephole.h"
+#include "../../common/inc/listing.h"
 
-Assembler::Assembler(const string& inputFile, const string& outputFile) : inputFile(inputFile), outputFile(outputFile), inputStream(*new ifstream), outputStream(*new ofstream) {
+// part of every cache key, bump it when the same source starts assembling differently
+const string Assembler::version = "sysSof-as 5";
 
+Assembler::Assembler(const string& inputFile, const string& outputFile, ostream& log) : inputFile(inputFile), outputFile(outputFile), log(log) {
+    includeDir = inputFile.substr(0, inputFile.find_last_of('/') + 1);
 }
 
 bool Assembler::assemble() {
-    symbolTable["UNDEFINED"].section = symbolTable["UNDEFINED"].name = "UNDEFINED";
-    symbolTable["ABSOLUTE"].section = symbolTable["ABSOLUTE"].name = "ABSOLUTE";
-    sectionTable["UNDEFINED"].name = "UNDEFINED";
-    sectionTable["ABSOLUTE"].name = "ABSOLUTE";
+    // Open File
+    inputStream.open(inputFile);
+    if(!inputStream.is_open()) {
+        log << "Couldn't open input file!" << endl;
+        return false;
+    }
+    string source((istreambuf_iterator<char>(inputStream)), istreambuf_iterator<char>());
+    inputStream.close();
+
+    string key;
+    if(cache) {
+        key = cache->key(source, blobStamps(source) + (optimize ? "-O" : "") + (listing ? "" : "-nolisting"));
+        if(cache->restore(key, listing ? outputFile : "", binaryFile())) {
+            if(stats) stats->count("cached", 1);
+            log << "ASSEMBLY SUCCESS (cached)" << endl;
+            return true;
+        }
+    }
 
-    if(!firstPass()) return false;   
-    if(!secondPass()) return false;
+    istringstream in(source);
+    if(!assembleSource(in)) return false;
 
-    outputStream.open(outputFile, ofstream::out | ofstream::trunc);
-    if(!outputStream.is_open()) {
-        cout << "Couldn't open output file!" << endl;
-        return false;
+    ostringstream object, binary;
+    if(listing) {
+        Stats::Phase phase(stats, "createTxt");
+        createTxt(object);
+    }
+    {
+        Stats::Phase phase(stats, "createBin");
+        createBin(binary);
+    }
+
+    if(listing) {
+        outputStream.open(outputFile, ofstream::out | ofstream::trunc);
+        if(!outputStream.is_open()) {
+            log << "Couldn't open output file!" << endl;
+            return false;
+        }
+        outputStream << object.str();
+        outputStream.close();
     }
-    createTxt(outputStream);
-    outputStream.close();
 
-    outputStream.open("bin_" + outputFile, ofstream::out | ofstream::binary | ofstream::trunc);
+    outputStream.open(binaryFile(), ofstream::out | ofstream::binary | ofstream::trunc);
     if(!outputStream.is_open()) {
-        cout << "Couldn't open output binary file!" << endl;
+        log << "Couldn't open output binary file!" << endl;
         return false;
     }
-    createBin(outputStream);
+    outputStream << binary.str();
+    outputStream.close();
+
+    if(cache) cache->store(key, object.str(), binary.str());
 
-    cout << "ASSEMBLY SUCCESS" << endl;
+    log << "ASSEMBLY SUCCESS" << endl;
     return true;
 }
 
-bool Assembler::firstPass() {
-    // Open File
-    inputStream.open(inputFile);
-    if(!inputStream.is_open()) {
-        cout << "Couldn't open input file!" << endl;
-        return false;
+string Assembler::binaryFile() {   // bin_ goes in front of the file name, not the directory
+    size_t slash = outputFile.find_last_of('/');
+    if(slash == string::npos) return "bin_" + outputFile;
+    return outputFile.substr(0, slash + 1) + "bin_" + outputFile.substr(slash + 1);
+}
+
+bool Assembler::assembleSource(istream& in) {
+    reset();
+    symbolTable["UNDEFINED"].section = symbolTable["UNDEFINED"].name = "UNDEFINED";
+    symbolTable["ABSOLUTE"].section = symbolTable["ABSOLUTE"].name = "ABSOLUTE";
+    sectionTable["UNDEFINED"].name = "UNDEFINED";
+    sectionTable["ABSOLUTE"].name = "ABSOLUTE";
+
+    stringstream optimized;
+    if(optimize) {
+        Stats::Phase phase(stats, "peephole");
+        vector<string> source;
+        for(string line; getline(in, line); ) source.push_back(parser.clearLine(line));
+        int changes = Peephole(parser).optimize(source);
+        for(const string& line : source) optimized << line << "\n";
+        if(stats) stats->count("peepholeChanges", changes);
+    }
+
+    {
+        Stats::Phase phase(stats, "firstPass");
+        if(!firstPass(optimize ? optimized : in)) return false;
+    }
+    {
+        Stats::Phase phase(stats, "secondPass");
+        if(!secondPass()) return false;
+    }
+
+    if(stats) {
+        size_t bytes = 0;
+        for(auto& se : sectionTable) bytes += se.second.size;
+        stats->count("lines", lineNum);
+        stats->count("symbols", symbolTable.size());
+        stats->count("sections", sectionTable.size());
+        stats->count("relocations", relocationTable.size());
+        stats->count("bytes", bytes);
     }
+    return true;
+}
+
+void Assembler::reset() {
+    lines.clear();
+    lineNum = 0;
+    position = 0;
+    currentSection = "UNDEFINED";
+    symbolTable.clear();
+    sectionTable.clear();
+    relocationTable.clear();
+    blobs.clear();
+}
+
+void Assembler::writeObject(ostream& out) {
+    createBin(out);
+}
 
+void Assembler::writeListing(ostream& out) {
+    createTxt(out);
+}
+
+bool Assembler::firstPass(istream& in) {
     string line;
-    while(getline(inputStream, line)) {
+    while(getline(in, line)) {
         lineNum++;
         line = parser.clearLine(line);
         if(line.length() == 0) continue; // skip empty lines      
@@ -88,6 +187,9 @@ bool Assembler::firstPass() {
             if(dir == ".skip") {
                 if(!handleSkipFirstPass(symbs)) return false;
             } else
+            if(dir == ".incbin") {
+                if(!handleIncbinFirstPass(symbs)) return false;
+            } else
             if(dir == ".equ") {
                 string symb = parser.getFirstBeforeComma(symbs);
                 string val = parser.getAfterComma(symbs);
@@ -111,114 +213,153 @@ bool Assembler::firstPass() {
 }
 
 bool Assembler::secondPass() {
-    currentSection = "UNDEFINED";
-    lineNum = 0;
-    position = 0;
-    for(string& line : lines) {
-        //cout << line << endl;
+    // Every section is encoded on its own: the symbol table is complete after the
+    // first pass and no section needs the bytes of another.
+    vector<SectionPass> passes;
+    map<string, size_t> passOf;
+    string section = "UNDEFINED";
+    for(size_t i = 0; i < lines.size(); i++) {
+        string left = parser.getLeft(lines[i]);
+        if(left == ".end") break;
+        if(left == ".section") section = parser.getFirstBeforeComma(parser.getRight(lines[i]));
+        if(!passOf.count(section)) {
+            passOf[section] = passes.size();
+            passes.emplace_back();
+            passes.back().section = section;
+            auto se = sectionTable.find(section);
+            passes.back().nobits = se != sectionTable.end() && se->second.nobits;
+        }
+        passes[passOf[section]].lines.push_back(i);
+    }
+
+    unsigned workers = min<size_t>(jobs, passes.size());
+    if(workers <= 1) {
+        for(SectionPass& pass : passes) secondPass(pass);
+    } else {
+        atomic<size_t> next{0};
+        vector<thread> pool;
+        for(unsigned i = 0; i < workers; i++) {
+            pool.emplace_back([&]() {
+                for(size_t p; (p = next++) < passes.size(); ) secondPass(passes[p]);
+            });
+        }
+        for(thread& t : pool) t.join();
+    }
+
+    // merge in the order the lines were written, as a single pass would have
+    vector<RelocationEntry> relocations;
+    for(SectionPass& pass : passes) {
+        SectionEntry& se = sectionTable[pass.section];
+        se.data.insert(se.data.end(), pass.data.begin(), pass.data.end());
+        se.offsets.insert(se.offsets.end(), pass.offsets.begin(), pass.offsets.end());
+        relocations.insert(relocations.end(), pass.relocations.begin(), pass.relocations.end());
+        for(const string& name : pass.missing) symbolTable[name];
+    }
+    bool ok = true;
+    for(SectionPass& pass : passes) {
+        for(const string& error : pass.errors) log << error << endl;
+        ok &= pass.errors.empty();
+    }
+    if(!ok) return false;
+    stable_sort(relocations.begin(), relocations.end(), [](const RelocationEntry& a, const RelocationEntry& b) {
+        return a.line < b.line;
+    });
+    relocationTable.insert(relocationTable.end(), relocations.begin(), relocations.end());
+    return true;
+}
+
+void Assembler::secondPass(SectionPass& pass) {
+    for(size_t i : pass.lines) {
+        const string& line = lines[i];
+        pass.line = i;
         string left = parser.getLeft(line);
         string right = parser.getRight(line);
         if (left == ".global" || left == ".extern" || left == ".equ") // skip second pass
             continue;
         if (left == ".section") {
-            currentSection = right;
-            position = 0;
-            //cout << "SECTION " << currentSection << endl;
+            pass.position = 0;
             continue;
         }
         if (left == ".skip") {
-            handleSkipSecondPass(parser.getNumberFromLiteral(right));
+            Expression::Value len;   // checked by the first pass
+            evaluate(right, len, &pass);
+            handleSkipSecondPass(len.value, pass);
             continue;
         }
-        if (left == ".end") // end second pass
-            break;
-        
         if (left == ".word") {
-            handleWordSecondPass(right);
+            handleWordSecondPass(right, pass);
+            continue;
+        }
+        if (left == ".incbin") {
+            handleIncbinSecondPass(blobs.at(i), pass);
             continue;
         }
 
         // Instruction
-        handleInstructionSecondPass(line);  
+        handleInstructionSecondPass(line, pass);
     }
-    return true;
 }
 
-bool Assembler::handleWordSecondPass(const string& arg) {
-    if(parser.isSymbol(arg)) {
-        SymbolEntry se = symbolTable[arg];
-        //cout << "WORD SYMBOL" << endl;
-        if(se.isDefined) {
-            if(se.section == "ABSOLUTE") {  // ABSOLUTE symbs don't need relocation
-                sectionTable[currentSection].offsets.push_back(position);
-                sectionTable[currentSection].data.push_back(se.value & 0xff);
-                sectionTable[currentSection].data.push_back((se.value >> 8) & 0xff);
-                return 0;
-            }
+// The symbol table is shared by all passes and must not grow while they run.
+// Names that aren't in it are remembered and added after the merge.
+const Assembler::SymbolEntry& Assembler::lookupSymbol(const string& name, SectionPass& pass) {
+    static const SymbolEntry missing;
+    auto it = symbolTable.find(name);
+    if(it != symbolTable.end()) return it->second;
+    pass.missing.push_back(name);
+    return missing;
+}
 
-            if(!se.isGlobal) {
-                sectionTable[currentSection].offsets.push_back(position);
-                sectionTable[currentSection].data.push_back(se.value & 0xff);
-                sectionTable[currentSection].data.push_back((se.value >> 8) & 0xff);
-                RelocationEntry re;
-                re.isData = true;
-                re.type = "R_SS_16";
-                re.section = currentSection;
-                re.offset = position;
-                re.symbolName = se.section;
-                relocationTable.push_back(re);
-            } else { //Global => Fill with zeroes
-                sectionTable[currentSection].offsets.push_back(position);
-                sectionTable[currentSection].data.push_back(0 & 0xff);
-                sectionTable[currentSection].data.push_back((0 >> 8) & 0xff);
-
-                RelocationEntry re;
-                re.isData = true;
-                re.type = "R_SS_16";
-                re.section = currentSection;
-                re.offset = position;
-                re.symbolName = se.name;
-                relocationTable.push_back(re);
-            }
+bool Assembler::handleWordSecondPass(const string& arg, SectionPass& pass) {
+    uint16_t dat = handleExpression(arg, pass, true, false);
+    pass.offsets.push_back(pass.position);
+    pass.data.push_back(dat & 0xff);
+    pass.data.push_back((dat >> 8) & 0xff);
 
-            position += 2;
-            return true;
-        }
-        //symbol is undefined => Fill with zeroes
-        sectionTable[currentSection].offsets.push_back(position);
-        sectionTable[currentSection].data.push_back(0 & 0xff);
-        sectionTable[currentSection].data.push_back((0 >> 8) & 0xff);
-
-        RelocationEntry re;
-        re.isData = true;
-        re.type = "R_SS_16";
-        re.section = currentSection;
-        re.offset = position;
-        re.symbolName = se.name;
-        relocationTable.push_back(re);
-
-        position += 2;
+    pass.position += 2;
+    return true;
+}
+
+bool Assembler::handleSkipSecondPass(const int& len, SectionPass& pass) {
+    //cout << "SKIP " << len << endl;
+    if(pass.nobits) {   // nothing to store
+        pass.position += len;
         return true;
     }
-    // arg is a literal
-    uint16_t dat = parser.getNumberFromLiteral(arg);
-    //cout << endl << arg << endl;
-    sectionTable[currentSection].offsets.push_back(position);
-    sectionTable[currentSection].data.push_back(dat & 0xff);
-    sectionTable[currentSection].data.push_back((dat >> 8) & 0xff);
-
-    position += 2;
+    pass.offsets.push_back(pass.position);
+    pass.data.resize(pass.data.size() + len, 0);
+    pass.position += len;
     return true;
 }
 
-bool Assembler::handleSkipSecondPass(const int& len) {
-    //cout << "SKIP " << len << endl;
-    sectionTable[currentSection].offsets.push_back(position);
-    for(int i = 0; i < len; i++) sectionTable[currentSection].data.push_back(0);
-    position += len;
+bool Assembler::handleIncbinSecondPass(const Blob& blob, SectionPass& pass) {
+    pass.offsets.push_back(pass.position);
+    pass.position += blob.length;
+    size_t start = pass.data.size();
+    pass.data.resize(start + blob.length, 0);
+
+    // read straight into the section, the file may have shrunk since the first pass
+    int fd = open(blob.file.c_str(), O_RDONLY);
+    size_t done = 0;
+    while(fd >= 0 && done < blob.length) {
+        ssize_t n = pread(fd, pass.data.data() + start + done, blob.length - done, blob.offset + done);
+        if(n <= 0) break;
+        done += n;
+    }
+    if(fd >= 0) close(fd);
+    if(done < blob.length) {
+        pass.errors.push_back(blob.file + " could not be read!");
+        return false;
+    }
     return true;
 }
 
+// like #include "file", relative to the including source
+string Assembler::includePath(const string& file) {
+    if(file.empty() || file[0] == '/') return file;
+    return includeDir + file;
+}
+
 bool Assembler::handleGlobal(const string& symb) {
     symbolTable[symb].isGlobal = true;
     symbolTable[symb].section = "UNDEFINED";
@@ -228,7 +369,7 @@ bool Assembler::handleGlobal(const string& symb) {
 
 bool Assembler::handleExtern(const string& symb) {
     if(symbolTable[symb].isDefined || symbolTable[symb].isGlobal) {
-        cout << lineNum << "\tExtern symbol defined/global." << endl; 
+        log << lineNum << "\tExtern symbol defined/global." << endl; 
         return false;
     }
     symbolTable[symb].isExtern = true;
@@ -237,11 +378,19 @@ bool Assembler::handleExtern(const string& symb) {
     return true;
 }
 
-bool Assembler::handleSection(const string& section) {
+bool Assembler::handleSection(const string& arg) {
     if(currentSection != "UNDEFINED") {
         sectionTable[currentSection].size = position;
     }
 
+    string section = parser.getFirstBeforeComma(arg);
+    string flags = parser.getAfterComma(arg);
+    if(flags != "" && flags != "nobits") {
+        log << lineNum << "\tUnknown section flag " << flags << "!" << endl;
+        return false;
+    }
+    if(flags == "nobits") sectionTable[section].nobits = true;
+
     //create new section
     symbolTable[section].section = section;
     symbolTable[section].name = section;
@@ -257,7 +406,11 @@ bool Assembler::handleSection(const string& section) {
 
 bool Assembler::handleWordFirstPass() {
     if(currentSection == "UNDEFINED") {
-        cout << lineNum << "\t.word outside of section!" << endl;
+        log << lineNum << "\t.word outside of section!" << endl;
+        return false;
+    }
+    if(sectionTable[currentSection].nobits) {
+        log << lineNum << "\t.word in a nobits section!" << endl;
         return false;
     }
 
@@ -267,20 +420,105 @@ bool Assembler::handleWordFirstPass() {
 
 bool Assembler::handleSkipFirstPass(const string& value) {
     if(currentSection == "UNDEFINED") {
-        cout << lineNum << "\t.skip outside of section!" << endl;
+        log << lineNum << "\t.skip outside of section!" << endl;
+        return false;
+    }
+
+    Expression::Value len;
+    if(!evaluate(value, len, nullptr)) return false;
+    if(!len.isAbsolute() || len.value < 0) {
+        log << lineNum << "\t.skip needs a constant size!" << endl;
+        return false;
+    }
+    position += len.value;
+    return true;
+}
+
+bool Assembler::handleIncbinFirstPass(const string& args) {
+    if(currentSection == "UNDEFINED") {
+        log << lineNum << "\t.incbin outside of section!" << endl;
+        return false;
+    }
+    if(sectionTable[currentSection].nobits) {
+        log << lineNum << "\t.incbin in a nobits section!" << endl;
         return false;
     }
 
-    position += parser.getNumberFromLiteral(value);
+    vector<string> fields;  // file, offset, length
+    stringstream ss(args);
+    for(string field; getline(ss, field, ','); ) fields.push_back(field);
+
+    Blob blob;
+    blob.file = fields.empty() ? "" : fields[0];
+    if(blob.file.size() < 2 || blob.file.front() != '"' || blob.file.back() != '"') {
+        log << lineNum << "\t.incbin needs a quoted file name!" << endl;
+        return false;
+    }
+    blob.file = includePath(blob.file.substr(1, blob.file.size() - 2));
+
+    struct stat st;
+    if(stat(blob.file.c_str(), &st) < 0) {
+        log << lineNum << "\t" << blob.file << " could not be opened!" << endl;
+        return false;
+    }
+    size_t size = st.st_size;
+
+    if(fields.size() > 3) {
+        log << lineNum << "\t.incbin takes a file, an offset and a length!" << endl;
+        return false;
+    }
+    for(size_t i = 1; i < fields.size(); i++) {
+        Expression::Value v;
+        if(!evaluate(fields[i], v, nullptr)) return false;
+        if(!v.isAbsolute() || v.value < 0) {
+            log << lineNum << "\t.incbin needs a constant offset and length!" << endl;
+            return false;
+        }
+        (i == 1 ? blob.offset : blob.length) = v.value;
+    }
+    if(fields.size() < 3) blob.length = size - min(size, blob.offset);
+    if(blob.offset > size || blob.length > size - blob.offset) {
+        log << lineNum << "\t.incbin past the end of " << blob.file << "!" << endl;
+        return false;
+    }
+
+    blobs[lines.size() - 1] = blob;
+    position += blob.length;
     return true;
 }
 
+// size and modification time of every file a source includes, so the cache
+// notices when one of them changes
+string Assembler::blobStamps(const string& source) {
+    static const regex incbin(R"rx(\.incbin\s+"([^"]*)")rx");
+    stringstream stamps;
+    for(sregex_iterator it(source.begin(), source.end(), incbin), end; it != end; it++) {
+        string file = includePath((*it)[1]);
+        struct stat st;
+        stamps << file << ":";
+        if(stat(file.c_str(), &st) == 0) {
+            stamps << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+        }
+        stamps << ";";
+    }
+    return stamps.str();
+}
+
 bool Assembler::handleEqu(const string& name, const string& value) {
     if(symbolTable[name].isDefined || symbolTable[name].isExtern) {
-        cout << lineNum << "\t.equ used with symbol that i already defined/extern." << endl;
+        log << lineNum << "\t.equ used with symbol that i already defined/extern." << endl;
         return false;
     }
-    int val = parser.getNumberFromLiteral(value);
+    Expression::Value v;
+    if(!evaluate(value, v, nullptr)) return false;
+    if(!v.isAbsolute()) {   // label plus a constant, defines a symbol in that section
+        symbolTable[name].isDefined = true;
+        symbolTable[name].section = v.base;
+        symbolTable[name].value = v.value;
+        symbolTable[name].name = name;
+        return true;
+    }
+    int val = v.value;
 
     symbolTable[name].isDefined = true;
     symbolTable[name].section = "ABSOLUTE";
@@ -297,7 +535,7 @@ bool Assembler::handleEqu(const string& name, const string& value) {
 
 bool Assembler::handleLabel(const string& name) {
     if(symbolTable[name].isDefined || symbolTable[name].isExtern) {
-        cout << lineNum << "\tSymbol is already defined/extern." << endl;
+        log << lineNum << "\tSymbol is already defined/extern." << endl;
         return false;
     }
 
@@ -313,481 +551,358 @@ bool Assembler::handleInstructionFirstPass(const string& line) {
     string instr = parser.getLeft(line);
     string oprnds = parser.getRight(line);
     if(currentSection == "UNDEFINED") {
-        cout << "Instruction not in section!" << endl;
+        log << "Instruction not in section!" << endl;
         return false;
     }
-
-    if(parser.noOperInstr(instr)) {
-        position += 1;
-        return true;
-    }
-
-    //cout << "!No" << endl;
-
-    if(parser.oneOperRegInstr(instr)) {
-        if(instr == "int" || instr == "not")
-            position+=2;
-        else
-        if(instr == "push" || instr == "pop")
-            position+=3;
-
-        return true;
-    }
-
-    //cout << "!OneReg" << endl;
-
-    if(parser.oneOperAllInstr(instr)) {
-        if(parser.absAddress(oprnds) || parser.pcRelAddress(oprnds) || parser.regIndDispAddress(oprnds) || parser.memDirAddress(oprnds))
-            position+=5;
-        else
-        if(parser.regDirAddress(oprnds) || parser.regIndAddress(oprnds))
-            position+=3;
-        
-        return true;
+    if(sectionTable[currentSection].nobits) {
+        log << lineNum << "\tInstruction in a nobits section!" << endl;
+        return false;
     }
 
-    //cout << "!OneOper" << endl;
-
-    if(parser.twoOperAllInstr(instr)) {
-        string oprnd = parser.getAfterComma(oprnds);
-        if(parser.absAddress(oprnd) || parser.pcRelAddress(oprnd) || parser.regIndDispAddress(oprnd) || parser.memDirAddress(oprnd))
-            position+=5;
-        else
-        if(parser.regDirAddress(oprnd) || parser.regIndAddress(oprnd))
-            position+=3;
-        
-        return true;
+    const isa::Instruction* in = parser.getInstruction(instr);
+    if(!in) {
+        log << "Unknown instruction " << instr << "!" << endl;
+        return false;
     }
 
-    //cout << "!TwoAll" << endl;
-
-    if(parser.twoOperRegInstr(instr)) {
-        position+=2;
-        
-        return true;
-    }
-    //cout << "!TwoReg" << endl;
+    int mode = isa::imm;
+    if(in->form == isa::jump) mode = operandMode(oprnds, true);
+    if(in->form == isa::load) mode = operandMode(parser.getAfterComma(oprnds), false);
+    if(mode < 0) return true;   // nothing is encoded for an operand that fits no mode
 
+    position += isa::size(in->form, mode);
     return true;
 }
 
-bool Assembler::handleInstructionSecondPass(const string& line) {
+// addressing mode of an operand, tried in the same order the second pass encodes them
+int Assembler::operandMode(const string& oprnd, bool isJump) {
+    if(isJump ? parser.absAddressJmp(oprnd) : parser.absAddress(oprnd)) return isa::imm;
+    if(parser.pcRelAddress(oprnd)) return isJump ? isa::regDirDisp : isa::regIndDisp;
+    if(parser.regDirAddress(oprnd)) return isa::regDir;
+    if(parser.regIndAddress(oprnd)) return isa::regInd;
+    if(parser.regIndDispAddress(oprnd)) return isa::regIndDisp;
+    if(parser.memDirAddress(oprnd)) return isa::memDir;
+    return -1;
+}
+
+bool Assembler::handleInstructionSecondPass(const string& line, SectionPass& pass) {
     string left = parser.getLeft(line);
     string right = parser.getRight(line);
 
+    const isa::Instruction* in = parser.getInstruction(left);
+    if(!in) return false;
+
     if(parser.noOperInstr(left)) {
-        if(left == "halt") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0x00);
-        } else
-        if(left == "iret") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0x20);
-        } else
-        if(left == "ret") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0x40);
-        }
-        position += 1;
+        pass.offsets.push_back(pass.position);
+        pass.data.push_back(in->code);
+        pass.position += 1;
     } else
     if(parser.oneOperRegInstr(left)) {
         int regNum = parser.getReg(right);
 
-        if(left == "int") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0x10);
-            sectionTable[currentSection].data.push_back((regNum << 4) + 15);
-            position += 2;
-        } else
-        if(left == "push") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0xb0);
-            sectionTable[currentSection].data.push_back((regNum << 4) + 6);
-            sectionTable[currentSection].data.push_back(0x12);
-            position += 3;
-        } else
-        if(left == "pop") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0xa0);
-            sectionTable[currentSection].data.push_back((regNum << 4) + 6);
-            sectionTable[currentSection].data.push_back(0x42);
-            position += 3;
-        } else
-        if(left == "not") {
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(0x80);
-            sectionTable[currentSection].data.push_back((regNum << 4) + 15);
-            position += 2;
+        if(in->form == isa::stack) {  // push and pop are str/ldr through sp
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(in->code);
+            pass.data.push_back((regNum << 4) + isa::spReg);
+            pass.data.push_back(left == "push" ? isa::pushMode : isa::popMode);
+            pass.position += 3;
+        } else {
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(in->code);
+            pass.data.push_back((regNum << 4) + 15);
+            pass.position += 2;
         }
     } else
     if(parser.oneOperAllInstr(left)) {
-        int instrDescr;
+        int instrDescr = in->code;
         int regDescr = 0xf0;
         int adrMode;
-        if(left == "call") instrDescr = 0x30; else
-        if(left == "jmp") instrDescr = 0x50; else
-        if(left == "jeq") instrDescr = 0x51; else
-        if(left == "jne") instrDescr = 0x52; else
-        if(left == "jgt") instrDescr = 0x53;
 
         if(parser.absAddressJmp(right)) {
             regDescr |= 0xf;
             adrMode = 0;
-            int val;
-
-            if(parser.isSymbol(right)) {
-                val = handleAbsoluteSymbol(right);
-            } else {
-                val = parser.getNumberFromLiteral(right);
-                
-            }
-
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back((val >> 8) & 0xff);
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position += 5;
+            int val = handleExpression(right, pass, false, false);
+
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back((val >> 8) & 0xff);
+            pass.data.push_back(val & 0xff);
+            pass.position += 5;
         } else if(parser.pcRelAddress(right)) {
             regDescr |= 0x7;
             adrMode = 0x05;
-            int val = handlePcRelSymbol(right);
-
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back((val >> 8) & 0xff);
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position += 5;
+            int val = handleExpression(parser.getExpression(right), pass, false, true);
+
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back((val >> 8) & 0xff);
+            pass.data.push_back(val & 0xff);
+            pass.position += 5;
         } else if(parser.regDirAddress(right)) {
             int regNum = parser.getReg(right);
             regDescr |= regNum;
             adrMode = 0x01;
 
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            position += 3;
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.position += 3;
         } else if(parser.regIndAddress(right)) {
             int regNum = parser.getReg(right);
             regDescr |= regNum;
             adrMode = 0x02;
 
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            position += 3;
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.position += 3;
         } else if(parser.regIndDispAddress(right)) {
             regDescr |= parser.getReg(right);
             adrMode = 0x03;
-            string disp = parser.getSymOrLit(right);
-            int val;
-            if(parser.isSymbol(disp)) {
-                val = handleAbsoluteSymbol(disp);
-            } else {
-                val = parser.getNumberFromLiteral(disp);
-            }
-            
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back((val >> 8) & 0xff);
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position += 5;
+            int val = handleExpression(parser.getExpression(right), pass, false, false);
+
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back((val >> 8) & 0xff);
+            pass.data.push_back(val & 0xff);
+            pass.position += 5;
         } else if(parser.memDirAddress(right)) {
             regDescr |= 0xf;
             adrMode = 0x04;
-            int val;
-            if(parser.isSymbol(right)) {
-                val = handleAbsoluteSymbol(right);
-            } else {
-                val = parser.getNumberFromLiteral(right);
-            }
-            
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDescr);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back((val >> 8) & 0xff);
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position += 5;
+            int val = handleExpression(right, pass, false, false);
+
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDescr);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back((val >> 8) & 0xff);
+            pass.data.push_back(val & 0xff);
+            pass.position += 5;
         }
     } else
     if(parser.twoOperAllInstr(left)) {
         string reg = parser.getFirstBeforeComma(right);
         string oprnd = parser.getAfterComma(right);
 
-        char instrDesc;
+        char instrDesc = in->code;
         char regDescr;
         char adrMode;
 
-        if(left == "ldr") instrDesc = 0xa0; else
-        if(left == "str") instrDesc = 0xb0;
-
         regDescr = parser.getReg(reg) << 4;
 
         if(parser.absAddress(oprnd)) {
-            oprnd =  parser.getSymOrLit(oprnd);
-            if(parser.isSymbol(oprnd)) {
-                regDescr |= 0xf;
-                adrMode = 0;
-                int val = handleAbsoluteSymbol(oprnd);
-                sectionTable[currentSection].offsets.push_back(position);
-                sectionTable[currentSection].data.push_back(instrDesc);
-                sectionTable[currentSection].data.push_back(regDescr);
-                sectionTable[currentSection].data.push_back(adrMode);
-                sectionTable[currentSection].data.push_back(0xff & (val >> 8));
-                sectionTable[currentSection].data.push_back(val & 0xff);
-                position+=5;
-            } else {
-                regDescr |= 0xf;
-                adrMode = 0;
-                int val = parser.getNumberFromLiteral(oprnd);
-                sectionTable[currentSection].offsets.push_back(position);
-                sectionTable[currentSection].data.push_back(instrDesc);
-                sectionTable[currentSection].data.push_back(regDescr);
-                sectionTable[currentSection].data.push_back(adrMode);
-                sectionTable[currentSection].data.push_back(0xff & (val >> 8));
-                sectionTable[currentSection].data.push_back(val & 0xff);
-                position+=5;
-            }
+            regDescr |= 0xf;
+            adrMode = 0;
+            int val = handleExpression(parser.getExpression(oprnd), pass, false, false);
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back(0xff & (val >> 8));
+            pass.data.push_back(val & 0xff);
+            pass.position+=5;
         } else
         if(parser.pcRelAddress(oprnd)) {
             regDescr |= 0x7;
             adrMode = 0x03;
-            int val = handlePcRelSymbol(oprnd);
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDesc);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back(0xff & (val >> 8));
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position+=5;
+            int val = handleExpression(parser.getExpression(oprnd), pass, false, true);
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back(0xff & (val >> 8));
+            pass.data.push_back(val & 0xff);
+            pass.position+=5;
         } else
         if(parser.regDirAddress(oprnd)) {
             regDescr |= parser.getReg(oprnd);
             adrMode = 0x01;
-            int val = handlePcRelSymbol(oprnd);
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDesc);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            position+=3;
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.position+=3;
         } else
         if(parser.regIndAddress(oprnd)) {
             regDescr |= parser.getReg(oprnd);
             adrMode = 0x02;
-            int val = handlePcRelSymbol(oprnd);
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDesc);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            position+=3;
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.position+=3;
         } else
         if(parser.regIndDispAddress(oprnd)) {
             regDescr |= parser.getReg(oprnd);
             adrMode = 0x03;
-            int val;
-            if(parser.isSymbol(oprnd)) {
-                val = handleAbsoluteSymbol(oprnd);
-            } else {
-                val = parser.getNumberFromLiteral(oprnd);
-            }
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDesc);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back(0xff & (val >> 8));
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position+=5;
+            int val = handleExpression(parser.getExpression(oprnd), pass, false, false);
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back(0xff & (val >> 8));
+            pass.data.push_back(val & 0xff);
+            pass.position+=5;
         } else
         if(parser.memDirAddress(oprnd)) {
             regDescr |= 0xf;
             adrMode = 0x04;
-            int val;
-            if(parser.isSymbol(oprnd)) {
-                val = handleAbsoluteSymbol(oprnd);
-            } else {
-                val = parser.getNumberFromLiteral(oprnd);
-            }
-            sectionTable[currentSection].offsets.push_back(position);
-            sectionTable[currentSection].data.push_back(instrDesc);
-            sectionTable[currentSection].data.push_back(regDescr);
-            sectionTable[currentSection].data.push_back(adrMode);
-            sectionTable[currentSection].data.push_back(0xff & (val >> 8));
-            sectionTable[currentSection].data.push_back(val & 0xff);
-            position+=5;
+            int val = handleExpression(oprnd, pass, false, false);
+            pass.offsets.push_back(pass.position);
+            pass.data.push_back(instrDesc);
+            pass.data.push_back(regDescr);
+            pass.data.push_back(adrMode);
+            pass.data.push_back(0xff & (val >> 8));
+            pass.data.push_back(val & 0xff);
+            pass.position+=5;
         }
     } else
     if(parser.twoOperRegInstr(left)) {
         string regD = parser.getFirstBeforeComma(right);
         string regS = parser.getAfterComma(right);
         
-        char instrDescr;
-        if(left == "xchg") instrDescr = 0x60; else
-        if(left == "add") instrDescr = 0x70; else
-        if(left == "sub") instrDescr = 0x71; else
-        if(left == "mul") instrDescr = 0x72; else
-        if(left == "div") instrDescr = 0x73; else
-        if(left == "cmp") instrDescr = 0x74; else
-        if(left == "and") instrDescr = 0x81; else
-        if(left == "or") instrDescr = 0x82; else
-        if(left == "xor") instrDescr = 0x83; else
-        if(left == "test") instrDescr = 0x84; else
-        if(left == "shl") instrDescr = 0x90; else
-        if(left == "shr") instrDescr = 0x91;
+        char instrDescr = in->code;
+        if(left == "xchg" && parser.regIndAddress(regS)) instrDescr++; // xchg regD, [regS] is atomic
 
 
         char regDescr = (parser.getReg(regD) << 4) | parser.getReg(regS);
 
-        sectionTable[currentSection].offsets.push_back(position);
-        sectionTable[currentSection].data.push_back(instrDescr);
-        sectionTable[currentSection].data.push_back(regDescr);
-        position += 2;
+        pass.offsets.push_back(pass.position);
+        pass.data.push_back(instrDescr);
+        pass.data.push_back(regDescr);
+        pass.position += 2;
     }
 
     return true;
 }
 
 
-int Assembler::handlePcRelSymbol(const string& symbol) {
-    SymbolEntry& se = symbolTable[parser.getSymOrLit(symbol)];
-    //cout << symbol << endl;
+// Value to encode for an operand or .word, adding the relocation it needs. Only
+// results that depend on another section or an external symbol are relocated.
+int Assembler::handleExpression(const string& expr, SectionPass& pass, bool isData, bool pcRel) {
+    Expression::Value v;
+    if(!evaluate(expr, v, &pass)) return 0;
 
-    if(se.section == "ABSOLUTE") {
-        RelocationEntry re;
-        re.isData = false;
-        re.offset = position + 4;
-        re.section = currentSection;
-        re.type = "R_SS_16_PC";
-        re.symbolName = se.name;
-        relocationTable.push_back(re);
-        return -2;
-    }
-
-    //Regular section
     RelocationEntry re;
-    re.isData = false;
-    re.offset = position + 4;
-    re.section = currentSection;
-    re.type = "R_SS_16_PC";
-    re.symbolName = se.name;
-
-    if(se.isGlobal || se.isExtern) {
-        re.symbolName = se.name;
-        relocationTable.push_back(re);
-        return -2; // leave the value to the linker
-    }  
-
-    if(currentSection == se.section) {
-        return se.value - position - 5;
+    re.isData = isData;
+    re.offset = isData ? pass.position : pass.position + 4; // opcode, regs, ua, higher, lower
+    re.section = pass.section;
+    re.type = pcRel ? "R_SS_16_PC" : "R_SS_16";
+
+    if(pcRel) {
+        if(v.base == pass.section) return v.value - pass.position - 5;    // pc after the instruction
+        re.symbolName = v.isAbsolute() ? "ABSOLUTE" : v.base;
+        pass.relocate(re);
+        return v.value - 2;
     }
 
-    re.symbolName = se.section;
-    relocationTable.push_back(re);
-    return se.value - 2;
+    if(v.isAbsolute()) return v.value;
+    re.symbolName = v.base;
+    pass.relocate(re);
+    return v.value;
 }
 
-int Assembler::handleAbsoluteSymbol(const string& symbol) {
-    SymbolEntry& se = symbolTable[symbol];
-
-    if(se.section == "ABSOLUTE") return se.value;
+// Symbols are absolute, an offset into their section, or left to the linker when
+// extern or undefined. Defined globals count as an offset into their section so
+// differences fold, a result that still needs relocating is made relative to the
+// global again. Without a pass only symbols defined so far can be used.
+bool Assembler::evaluate(const string& expr, Expression::Value& result, SectionPass* pass) {
+    vector<const SymbolEntry*> globals;
+    Expression expression([&](const string& name, Expression::Value& v, string& error) {
+        const SymbolEntry* se;
+        if(pass) {
+            se = &lookupSymbol(name, *pass);
+            if(se->name.empty()) {  // not in this file, the linker may know it
+                v.base = name;
+                return true;
+            }
+        } else {
+            auto it = symbolTable.find(name);
+            if(it == symbolTable.end() || !it->second.isDefined) {
+                error = name + " must be defined before it is used here";
+                return false;
+            }
+            se = &it->second;
+        }
 
-    RelocationEntry re; // Create relocation entry as not abs
-    re.isData = false;
-    re.offset = position + 4; // opcode, regs, ua, higher, lower
-    re.section = currentSection;
-    re.type = "R_SS_16";
+        if(se->section == "ABSOLUTE") {
+            v.value = se->value;
+        } else if(pass && (se->isExtern || !se->isDefined)) {
+            v.base = se->name;
+        } else {
+            v.base = se->section;
+            v.value = se->value;
+            if(pass && se->isGlobal) globals.push_back(se);
+        }
+        return true;
+    });
 
-    // value not needed
-    if(se.isGlobal || se.isExtern) {
-        re.symbolName = se.name;
-        relocationTable.push_back(re);
-        return 0;
+    if(expression.evaluate(expr, result)) {
+        for(const SymbolEntry* se : globals) {
+            if(se->section != result.base) continue;
+            result.base = se->name;     // same address, relocated against the global
+            result.value -= se->value;
+            break;
+        }
+        return true;
     }
-
-    // put real data
-    re.symbolName = se.section;
-    relocationTable.push_back(re);
-    return se.value;
+    string error = expr + ": " + expression.getError();
+    if(pass) {
+        pass->errors.push_back(error);
+    } else {
+        log << lineNum << "\t" << error << endl;
+    }
+    return false;
 }
 
 void Assembler::createTxt(ostream& out) {
-    out << "SECTION TABLE" << endl
-        << left << setw(10) << "NAME"
-        << left << setw(10) << "SIZE" 
-        << endl;
-    map<string, SectionEntry>::iterator it2;
-    for (it2 = sectionTable.begin(); it2 != sectionTable.end(); it2++)
-    {
-        SectionEntry& se = it2->second;
-        out << left << setw(10) << se.name
-            << right << setw(4) << setfill('0') << hex << se.size
-            << endl  << setfill(' ');
-    }
-
-    out << endl << "SYMBOL TABLE" << endl
-        << left << setw(14) << "NAME"
-        << left << setw(10) << "SECTION"
-        << left << setw(10) << "VALUE"
-        << left << setw(10) << "TYPE"
-        << endl;
-    map<string, SymbolEntry>::iterator it;
-    for (it = symbolTable.begin(); it != symbolTable.end(); it++)
-    {
-        SymbolEntry& se = it->second;
+    Listing txt;
+    txt << "SECTION TABLE\n";
+    txt.left("NAME", 10).left("SIZE", 10) << '\n';
+    for(auto& it : sectionTable) {
+        txt.left(it.second.name, 10).hex(it.second.size, 4) << '\n';
+    }
+
+    txt << "\nSYMBOL TABLE\n";
+    txt.left("NAME", 14).left("SECTION", 10).left("VALUE", 10).left("TYPE", 10) << '\n';
+    for(auto& it : symbolTable) {
+        SymbolEntry& se = it.second;
         if(se.name == "") continue;
-        out << left << setw(14) << se.name 
-            << left << setw(10) << se.section
-            << right << setw(4) << setfill('0') << hex << se.value << "      "
-            << left << (se.isGlobal ? "G" : (se.isExtern ? "E" : "L"))
-            << endl << setfill(' ');
+        txt.left(se.name, 14).left(se.section, 10).hex((unsigned)se.value, 4) << "      "
+            << (se.isGlobal ? 'G' : (se.isExtern ? 'E' : 'L')) << '\n';
     }
 
-    map<string, SectionEntry>::iterator secIt;
-    for (secIt = sectionTable.begin(); secIt != sectionTable.end(); secIt++)
-    {
-        SectionEntry& se = secIt->second;
-        out << endl << endl << "SECTION " << se.name << endl;
-        
-        out << "RELOCATION:" << endl;
-        out << left << setw(12) << "SYMBOL" << setw(10) << "OFFSET" << setw(12) << "R_TYPE" << setw(14) << "DAT/INSTR" << endl;
-        for(auto& re : relocationTable) {
-            if(re.section != se.name) continue;
-            out << left << setw(12) << re.symbolName << setw(10) << re.offset << setw(12) << re.type << setw(14) << (re.isData ? "DAT" : "INS") << endl;
-        }
+    map<string, vector<const RelocationEntry*>> relocations;    // by section, in table order
+    for(auto& re : relocationTable) relocations[re.section].push_back(&re);
 
-        out << "DATA:" << endl;
-        if(se.offsets.size() == 0) continue; // skip printout if empty
-        for(int i = 0; i < se.offsets.size() - 1; i++) {
-            int currOff = se.offsets[i];
-            int nextOff = se.offsets[i+1];
-            out << right << setw(4) << setfill('0') << hex << (0xffff & currOff) << ": ";
-            for (int j = currOff; j < nextOff; j++)
-            {
-                char c = se.data[j];
-                out << hex << setw(2) << (0xff & c) << " ";
-            }
-            out << endl;
+    for(auto& it : sectionTable) {
+        SectionEntry& se = it.second;
+        txt << "\n\nSECTION " << se.name << "\nRELOCATION:\n";
+        txt.left("SYMBOL", 12).left("OFFSET", 10).left("R_TYPE", 12).left("DAT/INSTR", 14) << '\n';
+        for(auto re : relocations[se.name]) {
+            txt.left(re->symbolName, 12).leftHex((unsigned)re->offset, 10).left(re->type, 12).left(re->isData ? "DAT" : "INS", 14) << '\n';
         }
-        //last one
-        out << right << hex << setw(4) << (0xffff & se.offsets[se.offsets.size() - 1]) << ": ";
-        for (int j = se.offsets[(int)se.offsets.size() - 1]; j < se.data.size(); j++)
-        {
-            char c = se.data[j];
-            out << hex << setw(2) << (0xff & c) << " ";
+
+        txt << "DATA:" << (se.nobits ? " NOBITS" : "") << '\n';
+        for(size_t i = 0; i < se.offsets.size(); i++) {    // one line per instruction or directive
+            size_t end = i + 1 < se.offsets.size() ? se.offsets[i + 1] : se.data.size();
+            txt.hex(0xffff & se.offsets[i], 4) << ": ";
+            for(size_t j = se.offsets[i]; j < end; j++) txt.byte(se.data[j]);
+            txt << '\n';
         }
-        out << endl << setfill(' ');
     }
-    out << dec;
+    txt.write(out);
 }
 
-void Assembler::createBin(ofstream& out) {
+void Assembler::createBin(ostream& out) {
     //write sym table size
     size_t symTSize = symbolTable.size();
     out.write((char*)&symTSize, sizeof(symTSize));
@@ -824,9 +939,8 @@ void Assembler::createBin(ofstream& out) {
         out.write(se.second.name.c_str(), len);
 
         out.write((char*)&se.second.size, sizeof(se.second.size)); // write size
-        for(auto& dat : se.second.data) {   // write data
-            out.write((char*)&dat, sizeof(dat));
-        }
+        out.write((char*)&se.second.nobits, sizeof(se.second.nobits));  // no data follows when set
+        out.write(se.second.data.data(), se.second.data.size());   // write data
         size_t offSize = se.second.offsets.size();
         out.write((char*)&offSize, sizeof(offSize)); // write size of offsets
         for(auto& off : se.second.offsets) {    // write offsets
@@ -865,8 +979,4 @@ void Assembler::createBin(ofstream& out) {
         // string symbolName;
         // bool isData;
     }
-
-    
-
-    out.close();
 }
\ No newline at end of file
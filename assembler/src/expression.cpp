@@ -0,0 +1,150 @@
+#include "../inc/expression.h"
+#include <cctype>
+
+bool Expression::evaluate(const string& text, Value& result) {
+    this->text = text;
+    pos = 0;
+    error.clear();
+
+    result = Value();
+    if(!parseOr(result)) return false;
+    skipSpaces();
+    if(pos != text.size()) return fail("unexpected " + text.substr(pos));
+    return true;
+}
+
+void Expression::skipSpaces() {
+    while(pos < text.size() && text[pos] == ' ') pos++;
+}
+
+bool Expression::accept(const string& op) {
+    skipSpaces();
+    if(text.compare(pos, op.size(), op) != 0) return false;
+    pos += op.size();
+    return true;
+}
+
+bool Expression::fail(const string& message) {
+    if(error.empty()) error = message;
+    return false;
+}
+
+bool Expression::absolute(const Value& a, const Value& b, const string& op) {
+    if(a.isAbsolute() && b.isAbsolute()) return true;
+    return fail("operands of " + op + " must be constants");
+}
+
+bool Expression::parseOr(Value& v) {
+    if(!parseXor(v)) return false;
+    while(accept("|")) {
+        Value r;
+        if(!parseXor(r) || !absolute(v, r, "|")) return false;
+        v.value |= r.value;
+    }
+    return true;
+}
+
+bool Expression::parseXor(Value& v) {
+    if(!parseAnd(v)) return false;
+    while(accept("^")) {
+        Value r;
+        if(!parseAnd(r) || !absolute(v, r, "^")) return false;
+        v.value ^= r.value;
+    }
+    return true;
+}
+
+bool Expression::parseAnd(Value& v) {
+    if(!parseShift(v)) return false;
+    while(accept("&")) {
+        Value r;
+        if(!parseShift(r) || !absolute(v, r, "&")) return false;
+        v.value &= r.value;
+    }
+    return true;
+}
+
+bool Expression::parseShift(Value& v) {
+    if(!parseAdd(v)) return false;
+    while(true) {
+        bool left = accept("<<");
+        if(!left && !accept(">>")) return true;
+        Value r;
+        if(!parseAdd(r) || !absolute(v, r, left ? "<<" : ">>")) return false;
+        if(r.value < 0 || r.value > 31) return fail("shift out of range");
+        v.value = left ? v.value << r.value : v.value >> r.value;
+    }
+}
+
+bool Expression::parseAdd(Value& v) {
+    if(!parseMul(v)) return false;
+    while(true) {
+        bool plus = accept("+");
+        if(!plus && !accept("-")) return true;
+        Value r;
+        if(!parseMul(r)) return false;
+        if(plus) {
+            if(!v.isAbsolute() && !r.isAbsolute()) return fail("can't add two relocatable values");
+            if(v.isAbsolute()) v.base = r.base;
+            v.value += r.value;
+        } else {
+            if(!r.isAbsolute()) {
+                if(r.base != v.base) return fail("can't subtract values from different sections");
+                v.base.clear();     // same base, the difference is known now
+            }
+            v.value -= r.value;
+        }
+    }
+}
+
+bool Expression::parseMul(Value& v) {
+    if(!parseUnary(v)) return false;
+    while(accept("*")) {
+        Value r;
+        if(!parseUnary(r) || !absolute(v, r, "*")) return false;
+        v.value *= r.value;
+    }
+    return true;
+}
+
+bool Expression::parseUnary(Value& v) {
+    if(accept("-") || accept("~")) {
+        char op = text[pos - 1];
+        if(!parseUnary(v)) return false;
+        if(!v.isAbsolute()) return fail(string("operand of ") + op + " must be a constant");
+        v.value = op == '-' ? -v.value : ~v.value;
+        return true;
+    }
+    if(accept("+")) return parseUnary(v);
+    return parsePrimary(v);
+}
+
+bool Expression::parsePrimary(Value& v) {
+    skipSpaces();
+    if(accept("(")) {
+        if(!parseOr(v)) return false;
+        if(!accept(")")) return fail("missing )");
+        return true;
+    }
+    if(pos >= text.size()) return fail("missing operand");
+
+    if(isdigit(text[pos])) {
+        size_t end;
+        try {
+            v.value = stoul(text.substr(pos), &end, text.compare(pos, 2, "0x") == 0 ? 16 : 10);
+        } catch(...) {
+            return fail("bad number " + text.substr(pos));
+        }
+        pos += end;
+        v.base.clear();
+        return true;
+    }
+
+    if(isalpha(text[pos])) {
+        size_t start = pos;
+        while(pos < text.size() && (isalnum(text[pos]) || text[pos] == '_')) pos++;
+        return resolve(text.substr(start, pos - start), v, error) || fail("bad symbol");
+    }
+
+    return fail("unexpected " + text.substr(pos));
+}
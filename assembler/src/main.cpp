@@ -1,33 +1,182 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include "../inc/assembler.h"
+#include "../inc/objectcache.h"
 
 using namespace std;
 
+// -stats prints a table, -stats=FILE writes the same as json for dashboards
+static bool writeStats(vector<Stats>& stats, const string& file) {
+    if(file.empty()) {
+        for(Stats& s : stats) s.writeText(cout);
+        return true;
+    }
+    ofstream out(file, ofstream::out | ofstream::trunc);
+    if(!out.is_open()) {
+        cout << "Couldn't open " << file << "!" << endl;
+        return false;
+    }
+    out << "{\"tool\":\"assembler\",\"version\":\"" << Assembler::version << "\",\"runs\":[";
+    for(size_t i = 0; i < stats.size(); i++) {
+        if(i) out << ",";
+        stats[i].writeJson(out);
+    }
+    out << "]}" << endl;
+    return true;
+}
+
+// a.s -> a.o in the current directory, like cc -c
+static string objectName(const string& source) {
+    string name = source.substr(source.find_last_of('/') + 1);
+    size_t dot = name.find_last_of('.');
+    return (dot == string::npos ? name : name.substr(0, dot)) + ".o";
+}
+
+// Assembles every source on its own Assembler, jobs at a time. Logs are kept per
+// file and printed in input order once all are done, so the output doesn't depend
+// on scheduling.
+static bool assembleAll(const vector<string>& sources, unsigned jobs, ObjectCache* cache, bool optimize, bool listing, vector<Stats>* stats) {
+    vector<string> objects;
+    set<string> seen;
+    for(const string& source : sources) {
+        objects.push_back(objectName(source));
+        if(!seen.insert(objects.back()).second) {
+            cout << source << ": " << objects.back() << " is produced by another input too!" << endl;
+            return false;
+        }
+    }
+
+    vector<ostringstream> logs(sources.size());
+    vector<char> ok(sources.size(), false);
+    atomic<size_t> next{0};
+    auto worker = [&]() {
+        for(size_t i; (i = next++) < sources.size(); ) {
+            Assembler assembler(sources[i], objects[i], logs[i]);
+            assembler.setCache(cache);
+            assembler.setOptimize(optimize);
+            assembler.setListing(listing);
+            if(stats) assembler.setStats(&(*stats)[i]);
+            ok[i] = assembler.assemble();
+        }
+    };
+
+    vector<thread> pool;
+    for(unsigned i = 0; i < jobs && i < sources.size(); i++) pool.emplace_back(worker);
+    for(thread& t : pool) t.join();
+
+    bool allOk = true;
+    for(size_t i = 0; i < sources.size(); i++) {
+        stringstream log(logs[i].str());
+        string line;
+        while(getline(log, line)) cout << sources[i] << ": " << line << endl;
+        allOk &= (bool)ok[i];
+    }
+    return allOk;
+}
+
 int main(int argc, const char *argv[])
 {
+    string outputPath;
+    vector<string> inputPaths;
+    unsigned jobs = max(1u, thread::hardware_concurrency());
+    string cacheDir;
+    uintmax_t cacheSize = 256 << 20;
+    bool optimize = false;
+    int listing = -1;   // text listings, by default only for a single input
+    bool showStats = false;
+    string statsFile;
+
     // Handle arguments
-    if(argc < 2) {
-        cout << "Invalid arguments" << endl;
-        return -1;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "-o" || arg == "-j") {
+            if(++i >= argc) {
+                cout << "Invalid arguments" << endl;
+                return -1;
+            }
+            if(arg == "-o") outputPath = argv[i];
+            else jobs = max(1, atoi(argv[i]));
+            continue;
+        }
+        if(arg == "-listing" || arg == "-nolisting") {
+            listing = arg == "-listing";
+            continue;
+        }
+        if(arg == "-stats" || arg.rfind("-stats=", 0) == 0) {  // time and count the phases
+            showStats = true;
+            if(arg.size() > 6) statsFile = arg.substr(7);
+            continue;
+        }
+        if(arg == "-O") {   // peephole pass over the source
+            optimize = true;
+            continue;
+        }
+        if(arg.rfind("-cache=", 0) == 0) {    // reuse objects of unchanged sources
+            cacheDir = arg.substr(7);
+            continue;
+        }
+        if(arg.rfind("-cachesize=", 0) == 0) {    // bound of the cache, e.g. -cachesize=64M
+            size_t suffix;
+            cacheSize = stoull(arg.substr(11), &suffix);
+            string unit = arg.substr(11 + suffix);
+            if(unit == "K") cacheSize <<= 10;
+            if(unit == "M") cacheSize <<= 20;
+            if(unit == "G") cacheSize <<= 30;
+            continue;
+        }
+        if(arg[0] == '@') {     // response file, one or more sources per line
+            ifstream list(arg.substr(1));
+            if(list.fail()) {
+                cout << arg.substr(1) << " could not be opened!" << endl;
+                return -1;
+            }
+            string source;
+            while(list >> source) inputPaths.push_back(source);
+            continue;
+        }
+        inputPaths.push_back(arg);
     }
 
-    string arg = argv[1];
-    if(arg == "-o" && argc != 4) {
+    if(inputPaths.empty()) {
         cout << "Invalid arguments" << endl;
         return -1;
     }
 
-    string outputPath = "out.o";
-    if(arg == "-o") {
-        outputPath = argv[2];
-    }
-    
-    string inputPath = argv[argc-1];
+    Stats::counting = showStats;
 
+    unique_ptr<ObjectCache> cache;
+    if(!cacheDir.empty()) {
+        cache.reset(new ObjectCache(cacheDir, cacheSize));
+        if(!cache->open()) return -1;
+    }
 
-    Assembler assembler(inputPath, outputPath);
-    assembler.assemble();
+    vector<Stats> stats(showStats ? inputPaths.size() : 0);
+    for(size_t i = 0; i < stats.size(); i++) stats[i].name = inputPaths[i];
 
+    bool ok;
+    if(inputPaths.size() == 1) {
+        Assembler assembler(inputPaths[0], outputPath.empty() ? "out.o" : outputPath);
+        assembler.setJobs(jobs);    // one file, spread its sections instead
+        assembler.setCache(cache.get());
+        assembler.setOptimize(optimize);
+        assembler.setListing(listing != 0);
+        if(showStats) assembler.setStats(&stats[0]);
+        ok = assembler.assemble();
+    } else {
+        if(!outputPath.empty()) {
+            cout << "-o can't be used with more than one input" << endl;
+            return -1;
+        }
+        ok = assembleAll(inputPaths, jobs, cache.get(), optimize, listing == 1, showStats ? &stats : nullptr);
+    }
 
-    return 0;
+    if(cache) cache->evict();
+    if(showStats && !writeStats(stats, statsFile)) return -1;
+    return ok ? 0 : -1;
 }
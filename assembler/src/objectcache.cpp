@@ -0,0 +1,118 @@
+#include "../inc/objectcache.h"
+#include "../inc/assembler.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// FNV-1a, run twice with different offsets for a 128 bit key
+static uint64_t fnv1a(const string& data, uint64_t hash) {
+    for(unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool ObjectCache::open() {
+    error_code ec;
+    fs::create_directories(dir, ec);
+    if(ec) {
+        cout << "Couldn't create cache directory " << dir << "!" << endl;
+        return false;
+    }
+    return true;
+}
+
+string ObjectCache::key(const string& source, const string& options) {
+    string header = Assembler::version + '\0' + options + '\0';
+    uint64_t h1 = fnv1a(source, fnv1a(header, 0xcbf29ce484222325ULL));
+    uint64_t h2 = fnv1a(source, fnv1a(header, 0x84222325cbf29ce4ULL));
+
+    stringstream ss;
+    ss << hex << setfill('0') << setw(16) << h1 << setw(16) << h2;
+    return ss.str();
+}
+
+// entry: size of the listing (8 bytes), the listing, then the binary object
+bool ObjectCache::restore(const string& key, const string& objectFile, const string& binaryFile) {
+    ifstream in(entryPath(key), ios::binary | ios::ate);
+    if(in.fail()) return false;
+    uint64_t entrySize = in.tellg();
+    in.seekg(0);
+
+    uint64_t objectSize;
+    in.read((char*)&objectSize, sizeof(objectSize));
+    if(in.fail()) return false;
+    if(objectSize > entrySize - sizeof(objectSize)) return false;  // truncated or corrupt, a miss
+    string object(objectSize, 0);
+    in.read(&object[0], objectSize);
+    if(in.fail()) return false;
+    string binary((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    if(!objectFile.empty() && !writeAtomic(objectFile, object)) return false;  // no listing wanted
+    if(!writeAtomic(binaryFile, binary)) return false;
+
+    error_code ec;  // a hit makes the entry the most recently used
+    fs::last_write_time(entryPath(key), fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+bool ObjectCache::store(const string& key, const string& object, const string& binary) {
+    uint64_t objectSize = object.size();
+    string entry((char*)&objectSize, sizeof(objectSize));
+    entry += object;
+    entry += binary;
+    return writeAtomic(entryPath(key), entry);
+}
+
+void ObjectCache::evict() {
+    struct Entry {
+        fs::path path;
+        uintmax_t size;
+        fs::file_time_type used;
+    };
+    vector<Entry> entries;
+    uintmax_t total = 0;
+
+    error_code ec;
+    for(auto& file : fs::directory_iterator(dir, ec)) {
+        if(file.path().extension() != ".obj") continue;
+        Entry e = {file.path(), file.file_size(ec), file.last_write_time(ec)};
+        if(ec) continue;    // removed by someone else meanwhile
+        total += e.size;
+        entries.push_back(e);
+    }
+    if(total <= maxBytes) return;
+
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for(Entry& e : entries) {
+        if(total <= maxBytes) break;
+        if(fs::remove(e.path, ec)) total -= e.size;
+    }
+}
+
+bool ObjectCache::writeAtomic(const string& file, const string& data) {
+    stringstream tmp;
+    tmp << file << ".tmp." << getpid() << "." << hash<thread::id>()(this_thread::get_id());
+
+    ofstream out(tmp.str(), ios::binary | ios::trunc);
+    out.write(data.data(), data.size());
+    out.close();
+    if(out.fail()) {
+        remove(tmp.str().c_str());
+        return false;
+    }
+    if(rename(tmp.str().c_str(), file.c_str()) != 0) {
+        remove(tmp.str().c_str());
+        return false;
+    }
+    return true;
+}
@@ -3,6 +3,13 @@
 #include <iterator>
 #include "../inc/parser.h"
 
+const string Parser::literal = "(-?[0-9]+)|(0x[0-9A-F]+)";
+const string Parser::symbol = "[a-zA-Z][a-zA-Z0-9_]*";
+const string Parser::registerRange = "[0-7]";
+const string Parser::symbolOrLiteral = Parser::symbol + "|" + Parser::literal;
+const string Parser::expression = R"([-~(]*()" + Parser::symbolOrLiteral + R"()\)*( ?(\+|-|\*|<<|>>|&|\||\^) ?[-~(]*()"
+    + Parser::symbolOrLiteral + R"()\)*)*)";
+
 string Parser::clearLine(string line) {
     string curr = line;
 
@@ -12,27 +19,27 @@ string Parser::clearLine(string line) {
 }
 
 string Parser::removeLabel(string line) {
-    regex reg(R"(.*:)");
+    static const regex reg(R"(.*:)");
     line = regex_replace(line, reg, "");
     return line;
 }
 
 string Parser::getSymOrLit(const string& oprnd) {
-    regex filter(R"((\**.* \+ )|\]|\$|\%)");
+    static const regex filter(R"((\**.* \+ )|\]|\$|\%)");
     return regex_replace(oprnd, filter, "");
 }
 
 void Parser::removeComments(string& line) {
-    regex reg(R"(#.*)");
+    static const regex reg(R"(#.*)");
     line = regex_replace(line, reg, "");
 }
 
 void Parser::removeExtraSpaces(string& line) {
-    regex multipleSpaces(R"( +)");
-    regex leadingSpace(R"(^ )");
-    regex trailingSpace(R"( $)");
-    regex columnWithSpaces(R"( *: *)");
-    regex commaWithSpaces(R"( *, *)");
+    static const regex multipleSpaces(R"( +)");
+    static const regex leadingSpace(R"(^ )");
+    static const regex trailingSpace(R"( $)");
+    static const regex columnWithSpaces(R"( *: *)");
+    static const regex commaWithSpaces(R"( *, *)");
     line = regex_replace(line, multipleSpaces, " ");
     line = regex_replace(line, leadingSpace, "");
     line = regex_replace(line, trailingSpace, "");
@@ -41,12 +48,12 @@ void Parser::removeExtraSpaces(string& line) {
 }
 
 bool Parser::containsLabel(const string& line) {
-    regex filter(R"(.*:.*)");
+    static const regex filter(R"(.*:.*)");
     return line != regex_replace(line, filter, "");
 }
 
 bool Parser::labelOnly(const string& line) {
-    regex filter(R"(:.*)");
+    static const regex filter(R"(:.*)");
     return line == regex_replace(line, filter, "") + ":";
 }
 
@@ -54,109 +61,121 @@ bool Parser::isDirective(const string& line) {
     return line.at(0) == '.';
 }
 
+const isa::Instruction* Parser::getInstruction(const string& instr) {
+    return isa::find(instr.data(), instr.size());
+}
+
 bool Parser::noOperInstr(const string& instr) {
-    regex filter(R"(^(halt|iret|ret))");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && in->form == isa::noOper;
 }
 
 bool Parser::oneOperRegInstr(const string& instr) {
-    regex filter(R"(int|push|pop|not)");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && (in->form == isa::oneReg || in->form == isa::stack);
 }
 
 bool Parser::oneOperAllInstr(const string& instr) {
-    regex filter(R"(call|jmp|jeq|jne|jgt)");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && in->form == isa::jump;
 }
 
 bool Parser::twoOperInstr(const string& instr) {
-    regex filter(R"(xchg|add|sub|mul|div|cmp|and|or|xor|test|shl|shr|ldr|str)");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && (in->form == isa::load || in->form == isa::twoReg);
 }
 
 bool Parser::twoOperAllInstr(const string& instr) {
-    regex filter(R"(ldr|str)");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && in->form == isa::load;
 }
 
 bool Parser::twoOperRegInstr(const string& instr) {
-    regex filter(R"(xchg|add|sub|mul|div|cmp|and|or|xor|test|shl|shr)");
-    return instr != regex_replace(instr, filter, "");
+    const isa::Instruction* in = getInstruction(instr);
+    return in && in->form == isa::twoReg;
 }
 
 bool Parser::isSymbol(const string& symb) {
-    regex filter("^(" + symbol + ")$");
+    static const regex filter("^(" + symbol + ")$");
     return regex_match(symb, filter);
 }
 
+string Parser::getExpression(const string& oprnd) {
+    static const regex disp(R"(^\**\[(r[0-7]|psw) ?\+ ?(.*)\]$)");
+    smatch m;
+    if(regex_match(oprnd, m, disp)) return m[2];
+    if(absAddress(oprnd) || pcRelAddress(oprnd)) return oprnd.substr(1);
+    return oprnd;
+}
+
 bool Parser::absAddress(const string& oprnd) {
-    regex filter(R"(^\$)");
+    static const regex filter(R"(^\$)");
     //cout << oprnd << endl;
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::absAddressJmp(const string& oprnd) {
-    regex filter("^(" + symbolOrLiteral + ")$");
+    static const regex filter("^(" + expression + ")$");
     //cout << oprnd << endl;
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::memDirAddress(const string& oprnd) {   // TODO: Check this
-    regex filter("^(" + symbolOrLiteral + ")$");
+    static const regex filter("^(" + expression + ")$");
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::pcRelAddress(const string& oprnd) {
-    regex filter(R"(^%)");
+    static const regex filter(R"(^%)");
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::regDirAddress(const string& oprnd) {
-    regex filter(R"(^(r[0-7]|psw)$)");
+    static const regex filter(R"(^(r[0-7]|psw)$)");
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::regIndAddress(const string& oprnd) {
-    regex filter(R"(^\[(r[0-7]|psw)\]$)");
+    static const regex filter(R"(^\[(r[0-7]|psw)\]$)");
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 bool Parser::regIndDispAddress(const string& oprnd) {   // TODO: Check this
-    regex filter(R"(^\**\[.*]$)");
+    static const regex filter(R"(^\**\[.*]$)");
     return oprnd != regex_replace(oprnd, filter, "");
 }
 
 string Parser::getLeft(const string& line) {
-    regex filter(R"( .*)");
+    static const regex filter(R"( .*)");
     return regex_replace(line, filter, "");
 }
 
 string Parser::getRight(const string& line) {
-    regex filter(R"(^[^\s]* )");
+    static const regex filter(R"(^[^\s]* )");
     return regex_replace(line, filter, "");
 }
 
 string Parser::getLabel(const string& line) {
-    regex filter(R"(:.*)");
+    static const regex filter(R"(:.*)");
     return regex_replace(line, filter, "");
 }
 
 string Parser::getFirstBeforeComma(const string& line) {
-    regex filter(R"(,.*)");
-    regex comma(R"(,)");
+    static const regex filter(R"(,.*)");
+    static const regex comma(R"(,)");
     string s = regex_replace(line, filter, "");
     s = regex_replace(s, comma, "");
     return s;
 }
 string Parser::getAfterComma(const string& line) {
-    regex filter(R"(.*?,)");
+    static const regex filter(R"(.*?,)");
     string s = regex_replace(line, filter, "");
     return line != s ? s : "";
 }
 
 int Parser::getNumberFromLiteral(const string& literal) {
     int ret;
-    regex pref(R"(^0x)");
+    static const regex pref(R"(^0x)");
     string noPref = regex_replace(literal, pref, "");
     if(noPref != literal) { // hex
         stringstream ss;
@@ -169,7 +188,7 @@ int Parser::getNumberFromLiteral(const string& literal) {
 }
 
 int Parser::getReg(const string& oprnd) {
-    regex pref(R"(r|(\*)|(\[)|(\])|( \+.*))");
+    static const regex pref(R"(r|(\*)|(\[)|(\])|( \+.*))");
     string reg = regex_replace(oprnd, pref, "");
     return stoi((reg == "psw") ? "8" : reg);
 }
\ No newline at end of file
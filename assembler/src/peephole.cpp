@@ -0,0 +1,159 @@
+#include "../inc/peephole.h"
+#include "../inc/expression.h"
+#include <set>
+
+int Peephole::optimize(vector<string>& lines) {
+    code.clear();
+    labels.clear();
+    for(size_t i = 0; i < lines.size(); i++) {
+        Line line;
+        string text = lines[i];
+        if(parser.getLeft(text) == ".end") {    // nothing after it is assembled
+            code.push_back({"", text});
+            break;
+        }
+        if(!text.empty() && parser.containsLabel(text)) {
+            line.label = parser.getLabel(text);
+            labels[line.label] = i;
+            text = parser.labelOnly(text) ? "" : parser.removeLabel(text);
+        }
+        line.stmt = text;
+        code.push_back(line);
+    }
+
+    int changes = 0;
+    for(int round = 0; round < 8; round++) {    // one change can open up another
+        int made = foldJumps() + removePushPop() + removeUnreachable() + shortenOperands();
+        if(!made) break;
+        changes += made;
+    }
+
+    for(size_t i = 0; i < code.size(); i++) {
+        lines[i] = code[i].label.empty() ? code[i].stmt : code[i].label + ":" + code[i].stmt;
+    }
+    return changes;
+}
+
+size_t Peephole::next(size_t i) {
+    for(i++; i < code.size(); i++) {
+        if(!code[i].stmt.empty()) return i;
+    }
+    return code.size();
+}
+
+bool Peephole::endsFlow(const string& stmt) {
+    string instr = parser.getLeft(stmt);
+    return instr == "halt" || instr == "jmp" || instr == "ret" || instr == "iret";
+}
+
+// only literals, symbols can't be trusted to keep their value
+bool Peephole::isConstantZero(const string& expr) {
+    Expression expression([](const string&, Expression::Value&, string&) { return false; });
+    Expression::Value v;
+    return expression.evaluate(expr, v) && v.value == 0;
+}
+
+// where a jump to operand ends up when it only lands on other jmps
+string Peephole::jumpTarget(const string& operand) {
+    bool pcRel = parser.pcRelAddress(operand);
+    string target = operand;
+    set<string> seen;
+    while(true) {
+        string symbol = pcRel ? target.substr(1) : target;
+        auto it = labels.find(symbol);
+        if(it == labels.end()) break;
+        if(!seen.insert(symbol).second) return operand;   // the jmps go round in a circle
+
+        size_t at = code[it->second].stmt.empty() ? next(it->second) : it->second;
+        if(at == code.size()) break;
+        // a label between the two doesn't matter, it is at the same address
+        const string& stmt = code[at].stmt;
+        if(parser.getLeft(stmt) != "jmp") break;
+        string onward = parser.getRight(stmt);
+        if(parser.pcRelAddress(onward) != pcRel) break;  // keep the addressing mode
+        if(!parser.isSymbol(pcRel ? onward.substr(1) : onward)) break;
+        target = onward;
+    }
+    return target;
+}
+
+int Peephole::removeUnreachable() {
+    int removed = 0;
+    for(size_t i = 0; i < code.size(); i++) {
+        if(code[i].stmt.empty() || !endsFlow(code[i].stmt)) continue;
+        // until the next label, directives may hold data something points to
+        for(size_t j = i + 1; j < code.size() && code[j].label.empty(); j++) {
+            if(code[j].stmt.empty()) continue;
+            if(parser.isDirective(code[j].stmt)) break;
+            code[j].stmt.clear();
+            removed++;
+        }
+    }
+    return removed;
+}
+
+int Peephole::removePushPop() {
+    int removed = 0;
+    for(size_t i = 0; i < code.size(); i++) {
+        if(parser.getLeft(code[i].stmt) != "push") continue;
+        size_t j = next(i);
+        if(j == code.size() || parser.getLeft(code[j].stmt) != "pop") continue;
+        // nothing may jump in between either
+        bool labelled = false;
+        for(size_t k = i + 1; k <= j; k++) labelled |= !code[k].label.empty();
+        if(labelled || parser.getRight(code[i].stmt) != parser.getRight(code[j].stmt)) continue;
+        code[i].stmt.clear();
+        code[j].stmt.clear();
+        removed += 2;
+    }
+    return removed;
+}
+
+int Peephole::foldJumps() {
+    int folded = 0;
+    for(Line& line : code) {
+        string instr = parser.getLeft(line.stmt);
+        const isa::Instruction* in = parser.getInstruction(instr);
+        if(!in || in->form != isa::jump) continue;
+
+        string operand = parser.getRight(line.stmt);
+        bool pcRel = parser.pcRelAddress(operand);
+        if(!parser.isSymbol(pcRel ? operand.substr(1) : operand)) continue;
+
+        string target = jumpTarget(operand);
+        if(target == operand) continue;
+        line.stmt = instr + " " + target;
+        folded++;
+    }
+    return folded;
+}
+
+int Peephole::shortenOperands() {
+    static const regex zeroDisp(R"(^(\[(r[0-7]|psw)) ?\+ ?(.*)\]$)");
+    int shortened = 0;
+    for(Line& line : code) {
+        string instr = parser.getLeft(line.stmt);
+        const isa::Instruction* in = parser.getInstruction(instr);
+        if(!in || (in->form != isa::jump && in->form != isa::load)) continue;
+
+        string right = parser.getRight(line.stmt);
+        string reg = in->form == isa::load ? parser.getFirstBeforeComma(right) : "";
+        string operand = in->form == isa::load ? parser.getAfterComma(right) : right;
+
+        // ldr rX, $0 is 5 bytes, xor rX, rX clears it in 2 and doesn't touch psw either
+        if(instr == "ldr" && parser.absAddress(operand) && reg != "psw" && isConstantZero(operand.substr(1))) {
+            line.stmt = "xor " + reg + "," + reg;
+            shortened++;
+            continue;
+        }
+
+        // [rX + 0] is [rX] without the payload
+        smatch m;
+        if(regex_match(operand, m, zeroDisp) && isConstantZero(m[3])) {
+            operand = string(m[1]) + "]";
+            line.stmt = instr + " " + (reg.empty() ? operand : reg + "," + operand);
+            shortened++;
+        }
+    }
+    return shortened;
+}
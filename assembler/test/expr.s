@@ -0,0 +1,33 @@
+# file expr.s
+# Constant expressions, folded at assembly time. The listing is compared with
+# expected/expr.txt.
+.global g1, g2
+.extern ext
+.equ base, 0x100
+.equ mask, (1 << 4) - 1
+.equ mixed, 2 + 3 * 4 - 10
+.equ bits, ~0xFF & 0xF0F0 | 0x3 ^ 0x1
+.equ neg, -(base >> 4)
+.section data
+g1:
+    .word 1
+g2:
+    .word mixed
+    .word bits
+    .word neg
+    .word g2 - g1
+    .word end - g1
+    .word g2 + 4
+    .word local + 2
+    .word ext - 2
+local:
+    .skip mask - 11
+    .word mask
+end:
+.section code
+    ldr r0, $base + mask
+    ldr r1, base + 2
+    ldr r2, [r1 + end - local]
+    ldr r3, $g2 - g1
+    jmp end
+.end
@@ -0,0 +1,89 @@
+# file flags.s
+# Prints one letter per case, 'A' plus the condition flags of psw: Z=1 O=2 C=4 N=8,
+# then g or n for every jgt. Expected output is in expected/flags.txt.
+.section ivt
+    .word start
+    .skip 14
+.section code
+.equ term_out, 0xFF00
+start:
+    ldr r6, $0xFE00
+# 0x7FFF + 1 overflows to 0x8000: N O
+    ldr r0, $0x7FFF
+    ldr r1, $1
+    add r0, r1
+    call show
+# 0xFFFF + 1 wraps to 0: Z C
+    ldr r0, $0xFFFF
+    add r0, r1
+    call show
+# 1 - 2 borrows: N C
+    ldr r0, $1
+    ldr r1, $2
+    cmp r0, r1
+    call show
+# -32768 - 1 overflows to 32767: O
+    ldr r0, $0x8000
+    ldr r1, $1
+    cmp r0, r1
+    call show
+# 0xC000 << 1, the last bit out is 1: N C
+    ldr r0, $0xC000
+    shl r0, r1
+    call show
+# 3 >> 1, the last bit out is 1: C
+    ldr r0, $3
+    shr r0, r1
+    call show
+# 0x8000 >> 1 keeps the sign: N
+    ldr r0, $0x8000
+    shr r0, r1
+    call show
+# 0x00F0 & 0x0F00 is 0: Z
+    ldr r0, $0x00F0
+    ldr r1, $0x0F00
+    test r0, r1
+    call show
+# the shift keeps O of the cmp before it: N O C
+    ldr r0, $0x8000
+    ldr r1, $1
+    cmp r0, r1
+    ldr r0, $0xC000
+    shl r0, r1
+    call show
+# test keeps C of the cmp before it: Z C
+    ldr r0, $1
+    ldr r1, $2
+    cmp r0, r1
+    ldr r0, $0x00F0
+    ldr r1, $0x0F00
+    test r0, r1
+    call show
+# jgt is signed: 5 > 3, not 3 > 5, not -32768 > 1
+    ldr r0, $5
+    ldr r1, $3
+    cmp r0, r1
+    call greater
+    cmp r1, r0
+    call greater
+    ldr r0, $0x8000
+    ldr r1, $1
+    cmp r0, r1
+    call greater
+    halt
+show:
+    ldr r2, psw
+    ldr r3, $0xF
+    and r2, r3
+    ldr r3, $65
+    add r2, r3
+    str r2, term_out
+    ret
+greater:
+    ldr r2, $103
+    jgt taken
+    ldr r2, $110
+taken:
+    str r2, term_out
+    ret
+.end
@@ -0,0 +1,78 @@
+# file irq.s
+# Interrupt priority and masking. The block device and the dma both raise their
+# line while it is masked, the handlers print the line number once it is unmasked.
+# Expected output is in expected/irq.txt.
+.section ivt
+    .word start
+    .word isr_error
+    .skip 4
+    .word isr_block
+    .word isr_dma
+    .skip 4
+.section code
+.equ term_out, 0xFF00
+.equ irq_priority, 0xFF26
+.equ irq_mask, 0xFF28
+.equ blk_cmd, 0xFF34
+.equ dma_len, 0xFF3C
+.equ dma_ctl, 0xFF3E
+start:
+    ldr r6, $0xFE00
+    ldr r0, $0
+    str r0, dma_len
+# lines 4 and 5 masked, 5 goes first
+    ldr r0, $0x30
+    str r0, irq_mask
+    ldr r0, $0x0500
+    str r0, irq_priority
+    call raise
+    ldr r0, $97
+    str r0, term_out
+    ldr r0, $0
+    str r0, irq_mask
+    ldr r0, $98
+    str r0, term_out
+# same again with 4 first, equal priorities go to the lower line
+    ldr r0, $0x30
+    str r0, irq_mask
+    ldr r0, $0x0507
+    str r0, irq_priority
+    ldr r0, $0x0407
+    str r0, irq_priority
+    call raise
+    ldr r0, $0
+    str r0, irq_mask
+# faults can't be masked
+    ldr r0, $0xFF
+    str r0, irq_mask
+    ldr r0, $1
+    ldr r1, $0
+    div r0, r1
+    ldr r0, $99
+    str r0, term_out
+    halt
+raise:
+    ldr r0, $1
+    str r0, blk_cmd
+    ldr r0, $2
+    str r0, dma_ctl
+    ret
+isr_error:
+    push r0
+    ldr r0, $69
+    str r0, term_out
+    pop r0
+    iret
+isr_block:
+    push r0
+    ldr r0, $52
+    str r0, term_out
+    pop r0
+    iret
+isr_dma:
+    push r0
+    ldr r0, $53
+    str r0, term_out
+    pop r0
+    iret
+.end
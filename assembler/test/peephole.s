@@ -0,0 +1,28 @@
+# file peephole.s
+# Assembled with -O. The listing is compared with expected/peephole.txt, every
+# kept or rewritten line below says what the peephole pass must do with it.
+.section code
+start:
+    push r1         # removed with the pop
+    pop r1
+    push r1         # kept, pops another register
+    pop r2
+    push r3         # kept, a label is in between
+again:
+    pop r3
+    ldr r0, $0      # xor r0, r0
+    ldr r0, $1 - 1  # xor r0, r0
+    ldr psw, $0     # kept, xor would not clear the flags
+    ldr r4, [r5 + 0]    # ldr r4, [r5]
+    str r4, [r5 + 2]    # kept
+    jeq hop         # jeq done, hop only jumps on
+    jmp again
+    ldr r1, $2      # removed, unreachable
+hop:
+    jmp done
+    halt            # removed, unreachable
+table:
+    .word 0
+done:
+    halt
+.end
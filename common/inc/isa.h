@@ -0,0 +1,193 @@
+#ifndef ISA_H
+#define ISA_H
+#include <cstddef>
+
+// The instruction set, described once for the assembler, the emulator and the
+// disassembler. Lookup tables are built from it at compile time and the checks at
+// the end of the file fail the build if the tools could disagree.
+namespace isa {
+
+// operand forms, they decide the encoding and the size
+enum Form : unsigned char {
+    noOper,     // halt
+    oneReg,     // int r1
+    stack,      // push r1, encoded as str/ldr through r6 with an update
+    jump,       // jmp operand, any addressing mode
+    load,       // ldr r1, operand, any addressing mode
+    twoReg      // add r1, r2
+};
+
+// addressing modes, low nibble of the third byte
+enum Mode : unsigned char {
+    imm = 0,
+    regDir = 1,
+    regInd = 2,
+    regIndDisp = 3,
+    memDir = 4,
+    regDirDisp = 5
+};
+
+// what the emulator does once the operands are fetched, jumps tell their condition by the modifier
+enum Exec : unsigned char {
+    execHalt, execInt, execIret, execCall, execRet, execJump, execXchg,
+    execAdd, execSub, execMul, execDiv, execCmp,
+    execNot, execAnd, execOr, execXor, execTest, execShl, execShr,
+    execLoad, execStore, execWait
+};
+
+struct Instruction {
+    const char* mnemonic;
+    unsigned char code;     // opcode in the high nibble, modifier in the low one
+    Form form;
+    unsigned char variants; // how many modifiers from code on decode to it, xchg has an atomic one
+    unsigned char cycles;   // cost in the emulator's cycle counter, memory accesses not included
+    Exec exec;
+};
+
+constexpr Instruction table[] = {
+    {"halt", 0x00, noOper, 1, 1, execHalt},
+    {"int",  0x10, oneReg, 1, 4, execInt},
+    {"iret", 0x20, noOper, 1, 4, execIret},
+    {"call", 0x30, jump,   1, 3, execCall},
+    {"ret",  0x40, noOper, 1, 3, execRet},
+    {"jmp",  0x50, jump,   1, 2, execJump},
+    {"jeq",  0x51, jump,   1, 2, execJump},
+    {"jne",  0x52, jump,   1, 2, execJump},
+    {"jgt",  0x53, jump,   1, 2, execJump},
+    {"xchg", 0x60, twoReg, 2, 2, execXchg},
+    {"add",  0x70, twoReg, 1, 2, execAdd},
+    {"sub",  0x71, twoReg, 1, 2, execSub},
+    {"mul",  0x72, twoReg, 1, 2, execMul},
+    {"div",  0x73, twoReg, 1, 2, execDiv},
+    {"cmp",  0x74, twoReg, 1, 2, execCmp},
+    {"not",  0x80, oneReg, 1, 1, execNot},
+    {"and",  0x81, twoReg, 1, 1, execAnd},
+    {"or",   0x82, twoReg, 1, 1, execOr},
+    {"xor",  0x83, twoReg, 1, 1, execXor},
+    {"test", 0x84, twoReg, 1, 1, execTest},
+    {"shl",  0x90, twoReg, 1, 1, execShl},
+    {"shr",  0x91, twoReg, 1, 1, execShr},
+    {"ldr",  0xa0, load,   1, 1, execLoad},
+    {"str",  0xb0, load,   1, 1, execStore},
+    {"push", 0xb0, stack,  1, 1, execStore},
+    {"pop",  0xa0, stack,  1, 1, execLoad},
+    {"wait", 0xc0, noOper, 1, 1, execWait},
+};
+constexpr int count = sizeof(table) / sizeof(table[0]);
+
+// stack operations are ldr/str through sp with these addressing bytes
+constexpr unsigned char pushMode = 0x12;    // pre-decrement, register indirect
+constexpr unsigned char popMode = 0x42;     // post-increment, register indirect
+constexpr int spReg = 6;
+constexpr int pcReg = 7;
+
+constexpr bool hasPayload(int mode) {
+    return mode != regDir && mode != regInd;
+}
+
+constexpr int size(Form form, int mode = imm) {
+    switch(form) {
+        case noOper: return 1;
+        case oneReg: return 2;
+        case twoReg: return 2;
+        case stack: return 3;
+        case jump:
+        case load: return hasPayload(mode) ? 5 : 3;
+    }
+    return 0;
+}
+
+// Perfect hash of the mnemonics. The constants were searched for the table above,
+// the static_assert below says when they need searching again.
+constexpr int hashSize = 64;
+
+constexpr size_t length(const char* s) {
+    size_t len = 0;
+    while(s[len]) len++;
+    return len;
+}
+
+constexpr unsigned hash(const char* s, size_t len) {
+    return ((unsigned char)s[0] * 5 + (unsigned char)s[1] * 13 + (unsigned char)s[len - 1] + len) % hashSize;
+}
+
+struct HashTable {
+    signed char slot[hashSize];
+};
+
+constexpr HashTable buildHashTable() {
+    HashTable t = {};
+    for(int i = 0; i < hashSize; i++) t.slot[i] = -1;
+    for(int i = 0; i < count; i++) t.slot[hash(table[i].mnemonic, length(table[i].mnemonic))] = i;
+    return t;
+}
+
+constexpr HashTable mnemonics = buildHashTable();
+
+constexpr const Instruction* find(const char* s, size_t len) {
+    if(len < 2) return nullptr;
+    int i = mnemonics.slot[hash(s, len)];
+    if(i < 0 || length(table[i].mnemonic) != len) return nullptr;
+    for(size_t c = 0; c < len; c++) {
+        if(table[i].mnemonic[c] != s[c]) return nullptr;
+    }
+    return &table[i];
+}
+
+// Decoding: first byte -> table entry. Stack operations share their bytes with
+// ldr/str and are told apart by the addressing byte, see isStack().
+struct DecodeTable {
+    signed char entry[256];
+};
+
+constexpr DecodeTable buildDecodeTable() {
+    DecodeTable t = {};
+    for(int i = 0; i < 256; i++) t.entry[i] = -1;
+    for(int i = 0; i < count; i++) {
+        if(table[i].form == stack) continue;
+        for(int v = 0; v < table[i].variants; v++) t.entry[table[i].code + v] = i;
+    }
+    return t;
+}
+
+constexpr DecodeTable decoder = buildDecodeTable();
+
+constexpr const Instruction* decode(unsigned char byte) {
+    return decoder.entry[byte] < 0 ? nullptr : &table[decoder.entry[byte]];
+}
+
+constexpr bool isStack(unsigned char code, unsigned char regs, unsigned char mode) {
+    return (regs & 0xf) == spReg && ((code == 0xb0 && mode == pushMode) || (code == 0xa0 && mode == popMode));
+}
+
+// compile time checks
+constexpr bool hashIsPerfect() {
+    for(int i = 0; i < count; i++) {
+        if(find(table[i].mnemonic, length(table[i].mnemonic)) != &table[i]) return false;
+    }
+    return true;
+}
+
+constexpr bool encodingsAreUnique() {
+    int seen[256] = {};
+    for(int i = 0; i < count; i++) {
+        if(table[i].form == stack) continue;
+        for(int v = 0; v < table[i].variants; v++) {
+            if(seen[table[i].code + v]++) return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool stackMatchesLoad() {
+    return find("push", 4)->code == find("str", 3)->code && find("pop", 3)->code == find("ldr", 3)->code;
+}
+
+static_assert(hashIsPerfect(), "mnemonic hash collides, search for new constants in hash()");
+static_assert(encodingsAreUnique(), "two instructions decode from the same byte");
+static_assert(stackMatchesLoad(), "push/pop must be encoded as str/ldr");
+static_assert(size(jump, regDir) == 3 && size(load, memDir) == 5, "payload sizes changed");
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef LISTING_H
+#define LISTING_H
+#include <string>
+#include <ostream>
+
+using namespace std;
+
+// hex digits of every byte, built at compile time
+struct HexTable {
+    char pairs[256][2];
+    constexpr HexTable() : pairs() {
+        const char* digits = "0123456789abcdef";
+        for(int i = 0; i < 256; i++) {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0xf];
+        }
+    }
+};
+
+// Text of the assembler and linker listings. Everything is appended to one buffer
+// and written with a single call, numbers go through a digit table instead of
+// stream manipulators.
+class Listing {
+private:
+    static constexpr HexTable hexTable{};
+
+    string buf;
+
+public:
+    Listing() { buf.reserve(1 << 16); }
+
+    Listing& operator<<(const string& s) { buf += s; return *this; }
+    Listing& operator<<(const char* s) { buf += s; return *this; }
+    Listing& operator<<(char c) { buf += c; return *this; }
+
+    // like setw(width) << left
+    Listing& left(const string& s, size_t width) {
+        buf += s;
+        if(s.size() < width) buf.append(width - s.size(), ' ');
+        return *this;
+    }
+
+    // like setw(width) << right << setfill(fill) << hex, never truncated
+    Listing& hex(unsigned long long value, size_t width, char fill = '0') {
+        char digits[16];
+        size_t n = 0;
+        do {
+            digits[n++] = hexTable.pairs[value & 0xf][1];
+            value >>= 4;
+        } while(value);
+        if(n < width) buf.append(width - n, fill);
+        while(n) buf += digits[--n];
+        return *this;
+    }
+
+    // like setw(width) << left << hex
+    Listing& leftHex(unsigned long long value, size_t width) {
+        size_t start = buf.size();
+        hex(value, 0);
+        size_t n = buf.size() - start;
+        if(n < width) buf.append(width - n, ' ');
+        return *this;
+    }
+
+    // two digits and a space, the data dumps are made of these
+    Listing& byte(unsigned char b) {
+        buf.append(hexTable.pairs[b], 2);
+        buf += ' ';
+        return *this;
+    }
+
+    void write(ostream& out) {
+        out.write(buf.data(), buf.size());
+        buf.clear();
+    }
+};
+
+#endif
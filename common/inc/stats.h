@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+
+using namespace std;
+
+// Wall time and allocations of the phases of one run, and counts of what went
+// through them, for -stats. Allocations are only counted by programs that link in
+// common/src/allocations.cpp and set counting, and are process wide: runs on other
+// threads at the same time show up in each other's numbers.
+class Stats {
+public:
+    static inline atomic<bool> counting{false};     // off, allocating costs no shared atomic
+    static inline atomic<unsigned long long> allocations{0};
+
+    // times the scope it lives in, does nothing without a Stats
+    class Phase {
+    private:
+        Stats* stats;
+        const char* name;
+        chrono::steady_clock::time_point start;
+        unsigned long long allocationsAtStart;
+
+    public:
+        Phase(Stats* stats, const char* name) : stats(stats), name(name) {
+            if(!stats) return;
+            start = chrono::steady_clock::now();
+            allocationsAtStart = allocations;
+        }
+        ~Phase() {
+            if(!stats) return;
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            stats->phases.push_back({name, elapsed.count(), allocations - allocationsAtStart});
+        }
+    };
+
+    string name;    // what the run was about, a file usually
+
+    void count(const string& what, unsigned long long n) { counts.push_back({what, n}); }
+
+    void writeText(ostream& out) {
+        out << name << endl;
+        for(auto& p : phases) {
+            out << "  " << left << setw(24) << p.name << right << fixed << setprecision(6) << setw(12) << p.seconds << " s"
+                << setw(12) << p.allocations << " allocations" << endl;
+        }
+        for(auto& c : counts) {
+            out << "  " << left << setw(24) << c.first << right << setw(12) << c.second << endl;
+        }
+        out << defaultfloat;
+    }
+
+    void writeJson(ostream& out) {
+        out << "{\"name\":\"" << escape(name) << "\",\"phases\":[";
+        for(size_t i = 0; i < phases.size(); i++) {
+            out << (i ? "," : "") << "{\"name\":\"" << phases[i].name << "\",\"seconds\":" << fixed << setprecision(9)
+                << phases[i].seconds << defaultfloat << ",\"allocations\":" << phases[i].allocations << "}";
+        }
+        out << "],\"counts\":{";
+        for(size_t i = 0; i < counts.size(); i++) {
+            out << (i ? "," : "") << "\"" << counts[i].first << "\":" << counts[i].second;
+        }
+        out << "}}";
+    }
+
+    static string escape(const string& s) {
+        string escaped;
+        for(char c : s) {
+            if(c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+private:
+    struct Entry {
+        const char* name;
+        double seconds;
+        unsigned long long allocations;
+    };
+
+    vector<Entry> phases;
+    vector<pair<string, unsigned long long>> counts;
+};
+
+#endif
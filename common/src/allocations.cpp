@@ -0,0 +1,14 @@
+#include <new>
+#include <cstdlib>
+#include "../inc/stats.h"
+
+// Counts allocations for -stats in the tools that link this in. It is a translation
+// unit of its own so new and delete are never inlined into their callers.
+void* operator new(size_t size) {
+    if(Stats::counting.load(memory_order_relaxed)) Stats::allocations.fetch_add(1, memory_order_relaxed);
+    if(void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
@@ -0,0 +1,27 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+#include <string>
+#include <vector>
+#include <ostream>
+
+using namespace std;
+
+// Turns the linker's memory images back into assembly, decoding through the
+// shared isa table so it reads exactly what the emulator executes
+class Disassembler {
+private:
+    vector<unsigned char> mem = vector<unsigned char>(1 << 16, 0);
+    vector<pair<int, int>> ranges;  // [start, end) of every loaded segment
+
+    unsigned short word(unsigned short address);    // payload, high byte first
+    string hexLiteral(int value);
+    string operand(int mode, int reg, short payload, unsigned short next, bool isJump);
+
+public:
+    bool loadImage(const string& file);   // flat 64KiB image or segmented (SSEG)
+    int decode(unsigned short address, string& text);  // returns the size of the instruction
+    void disassemble(ostream& out, int start, int end);
+    void disassemble(ostream& out);     // every loaded segment
+};
+
+#endif
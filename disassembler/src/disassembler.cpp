@@ -0,0 +1,152 @@
+#include "../inc/disassembler.h"
+#include "../../common/inc/isa.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+bool Disassembler::loadImage(const string& file) {
+    ifstream in(file, ios::binary | ios::ate);
+    if(in.fail()) {
+        cout << file << " could not be opened!" << endl;
+        return false;
+    }
+    vector<char> image(in.tellg());
+    in.seekg(0);
+    in.read(image.data(), image.size());
+
+    if(image.size() < 8 || string(image.data(), 4) != "SSEG") { // flat image, stop at the last used byte
+        size_t len = min(image.size(), mem.size());
+        copy(image.begin(), image.begin() + len, mem.begin());
+        while(len > 0 && !mem[len - 1]) len--;
+        ranges.push_back(make_pair(0, (int)len));
+        return true;
+    }
+
+    // segmented: "SSEG", count, then address, size and data of every segment,
+    // segments with zeroFill set in the size have no data and nothing to disassemble
+    static const uint32_t zeroFill = 1u << 31;
+    uint32_t count;
+    size_t pos = 4;
+    memcpy(&count, image.data() + pos, sizeof(count));
+    pos += sizeof(count);
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t address, len;
+        if(pos + sizeof(address) + sizeof(len) > image.size()) break;
+        memcpy(&address, image.data() + pos, sizeof(address));
+        memcpy(&len, image.data() + pos + sizeof(address), sizeof(len));
+        pos += sizeof(address) + sizeof(len);
+        if(len & zeroFill) continue;
+        if(pos + len > image.size()) {
+            cout << file << " is not a valid image!" << endl;
+            return false;
+        }
+        if((size_t)address + len <= mem.size()) {   // banks above 64KiB have no address to show
+            memcpy(mem.data() + address, image.data() + pos, len);
+            ranges.push_back(make_pair((int)address, (int)(address + len)));
+        }
+        pos += len;
+    }
+    return true;
+}
+
+unsigned short Disassembler::word(unsigned short address) {
+    return (mem[address] << 8) | mem[(unsigned short)(address + 1)];
+}
+
+string Disassembler::hexLiteral(int value) {
+    stringstream ss;
+    ss << "0x" << uppercase << hex << (value & 0xffff);
+    return ss.str();
+}
+
+string Disassembler::operand(int mode, int reg, short payload, unsigned short next, bool isJump) {
+    string r = reg == isa::pcReg ? "pc" : "r" + to_string(reg);
+    string star = isJump ? "*" : "";
+    switch(mode) {
+        case isa::imm:
+            return (isJump ? "" : "$") + hexLiteral(payload);
+        case isa::regDir:
+            return star + r;
+        case isa::regInd:
+            return star + "[" + r + "]";
+        case isa::regIndDisp:
+            if(reg == isa::pcReg && !isJump) return "%" + hexLiteral(next + payload);
+            return star + "[" + r + " + " + hexLiteral(payload) + "]";
+        case isa::memDir:
+            return star + hexLiteral(payload);
+        case isa::regDirDisp:
+            if(reg == isa::pcReg) return "%" + hexLiteral(next + payload);
+            return star + r + " + " + hexLiteral(payload);
+    }
+    return "?";
+}
+
+int Disassembler::decode(unsigned short address, string& text) {
+    unsigned char code = mem[address];
+    unsigned char regs = mem[(unsigned short)(address + 1)];
+    unsigned char modeByte = mem[(unsigned short)(address + 2)];
+    const isa::Instruction* in = isa::decode(code);
+    if(!in) {
+        text = ".byte " + hexLiteral(code);
+        return 1;
+    }
+
+    int regD = regs >> 4;
+    int regS = regs & 0xf;
+    string name = in->mnemonic;
+    switch(in->form) {
+        case isa::noOper:
+            text = name;
+            break;
+        case isa::oneReg:
+            text = name + " r" + to_string(regD);
+            break;
+        case isa::twoReg:
+            if(code != in->code) text = name + " r" + to_string(regD) + ", [r" + to_string(regS) + "]"; // atomic xchg
+            else text = name + " r" + to_string(regD) + ", r" + to_string(regS);
+            break;
+        case isa::jump:
+        case isa::load: {
+            int mode = modeByte & 0xf;
+            if(in->form == isa::load && isa::isStack(code, regs, modeByte)) {
+                text = string(code == isa::find("push", 4)->code ? "push" : "pop") + " r" + to_string(regD);
+                return isa::size(isa::stack);
+            }
+            int size = isa::size(in->form, mode);
+            short payload = isa::hasPayload(mode) ? word(address + 3) : 0;
+            unsigned short next = address + size;
+            if(in->form == isa::jump) text = name + " " + operand(mode, regS, payload, next, true);
+            else text = name + " r" + to_string(regD) + ", " + operand(mode, regS, payload, next, false);
+            return size;
+        }
+        case isa::stack:
+            break;
+    }
+    return isa::size(in->form);
+}
+
+void Disassembler::disassemble(ostream& out, int start, int end) {
+    int address = start;
+    while(address < end) {
+        string text;
+        int size = decode(address, text);
+
+        // ADDRESS: BYTES INSTRUCTION
+        out << hex << setw(4) << setfill('0') << address << ": ";
+        for(int i = 0; i < 5; i++) {
+            if(i < size) out << setw(2) << (int)mem[(unsigned short)(address + i)] << " ";
+            else out << "   ";
+        }
+        out << setfill(' ') << " " << text << endl;
+        address += size;
+    }
+}
+
+void Disassembler::disassemble(ostream& out) {
+    for(auto& range : ranges) {
+        disassemble(out, range.first, range.second);
+        out << endl;
+    }
+}
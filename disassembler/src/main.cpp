@@ -0,0 +1,39 @@
+#include <iostream>
+#include <string>
+
+#include "../inc/disassembler.h"
+
+using namespace std;
+
+int main(int argc, const char *argv[])
+{
+    string imageFile;
+    int start = -1;
+    int end = 1 << 16;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg.rfind("-start=", 0) == 0) {  // first address, hex
+            start = stoi(arg.substr(7), nullptr, 16);
+            continue;
+        }
+        if(arg.rfind("-end=", 0) == 0) {    // one past the last address, hex
+            end = stoi(arg.substr(5), nullptr, 16);
+            continue;
+        }
+        imageFile = arg;
+    }
+
+    if(imageFile.empty()) {
+        cout << "Memory image needed!!" << endl;
+        return -1;
+    }
+
+    Disassembler disassembler;
+    if(!disassembler.loadImage(imageFile)) return -1;
+
+    if(start >= 0) disassembler.disassemble(cout, start, min(end, 1 << 16));
+    else disassembler.disassemble(cout);
+
+    return 0;
+}
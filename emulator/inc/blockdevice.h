@@ -0,0 +1,29 @@
+#ifndef BLOCKDEVICE_H
+#define BLOCKDEVICE_H
+#include <string>
+
+using namespace std;
+
+// Disk image mapped into the host address space, the guest sees it as an array
+// of fixed size sectors
+class BlockDevice {
+private:
+    int fd = -1;
+    char* data = nullptr;
+    size_t size = 0;
+
+public:
+    static const size_t sectorSize = 512;
+
+    BlockDevice() {}
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+    ~BlockDevice() { close(); }
+
+    bool open(const string& file);
+    void close();
+    size_t sectors() { return size / sectorSize; }
+    char* sector(unsigned short n) { return n < sectors() ? data + n * sectorSize : nullptr; }
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include <string>
+#include <vector>
+#include "symbols.h"
+
+using namespace std;
+
+// Set associative cache with lru replacement, fed with the guest's memory
+// accesses. Lines are tagged by physical address, statistics are kept per
+// guest address and per physical frame for the report.
+class Cache {
+private:
+    struct Way {
+        size_t tag = 0;
+        bool valid = false;
+        unsigned long long lastUse = 0;
+    };
+
+    size_t size = 4096;
+    int ways = 4;
+    int lineSize = 16;
+    size_t sets = 64;
+    vector<Way> lines;  // sets * ways
+    unsigned long long clock = 0;
+
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    vector<unsigned> accessesAt;    // per guest address
+    vector<unsigned> missesAt;
+    vector<unsigned long long> frameAccesses;   // per physical frame
+    vector<unsigned long long> frameMisses;
+
+    Symbols symbols;
+
+public:
+    static const size_t frameSize = 1 << 12;
+
+    bool fetches = false;   // instruction fetches go through the cache too
+
+    Cache() : accessesAt(1 << 16), missesAt(1 << 16) { configure(size, ways, lineSize); }
+    bool configure(size_t size, int ways, int lineSize);
+    bool loadSymbols(const string& listing) { return symbols.load(listing); }
+    void access(unsigned short address, size_t physical);
+    bool write(const string& file);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+#include <string>
+#include "emulator.h"
+#include "symbols.h"
+#include "../../common/inc/isa.h"
+
+using namespace std;
+
+// Guest code coverage, one byte of flags per guest address
+class Coverage {
+private:
+    unsigned char bitmap[1 << 16] = {};
+    Symbols symbols;
+
+public:
+    static const unsigned char executed = 1;
+    static const unsigned char taken = 2;       // conditional jump taken
+    static const unsigned char notTaken = 4;    // conditional jump fell through
+
+    static bool isBranch(char inst) { return (inst & 0xf0) == 0x50 && (inst & 0xf) != 0; } // jeq, jne, jgt
+
+    // mode is the addressing byte of a branch, it decides where the fall through lands
+    void record(unsigned short pc, char inst, char mode, unsigned short nextPc) {
+        unsigned char bits = executed;
+        if(isBranch(inst)) {
+            unsigned short fallThrough = pc + isa::size(isa::jump, mode & 0xf);
+            bits |= nextPc == fallThrough ? notTaken : taken;
+        }
+        // every cpu records into the same bitmap under -smp, the locked or is only paid for new bits
+        if((__atomic_load_n(&bitmap[pc], __ATOMIC_RELAXED) & bits) != bits) __atomic_fetch_or(&bitmap[pc], bits, __ATOMIC_RELAXED);
+    }
+
+    bool loadSymbols(const string& listing) { return symbols.load(listing); }
+    bool write(const string& file);
+    void clear();
+};
+
+template<class Base>
+struct CoverageHooks : Base {
+    static const bool retire = true;
+
+    Coverage& coverage;
+    CoverageHooks(Coverage& coverage) : coverage(coverage) {}
+
+    void onRetire(Emulator& emu, unsigned short pc, char inst) {
+        char mode = 0;
+        if(Coverage::isBranch(inst)) emu.readMemory(pc + 2, &mode, 1);
+        coverage.record(pc, inst, mode, emu.getReg(7));
+    }
+};
+
+#endif
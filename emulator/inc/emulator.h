@@ -2,15 +2,129 @@
 #define EMULATOR_H
 #include <string>
 #include <fstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "blockdevice.h"
+#include "eventlog.h"
 
 using namespace std;
 
+class Emulator;
+class Coverage;
+class Cache;
+
+// Compile time hooks for step() and runUntil(). Derive from NoHooks and hide the
+// members you need, calls guarded by a false flag are compiled away. Device hooks
+// are reached from deep inside the memory access path, so with devices set they
+// are bound through a plain function pointer for the duration of the call and
+// looked up on mmio accesses only.
+struct NoHooks {
+    static const bool trace = false;        // onInstruction() before every instruction
+    static const bool devices = false;      // onRead()/onWrite() for the mmio page
+    static const bool hostDevices = false;  // poll the terminal and the timer
+    static const bool retire = false;       // onRetire() after every instruction
+
+    void onInstruction(Emulator& /*emu*/, unsigned short /*pc*/) {}
+    void onRetire(Emulator& /*emu*/, unsigned short /*pc*/, char /*inst*/) {}
+    bool onRead(Emulator& /*emu*/, unsigned short /*address*/, short& /*value*/) { return false; }  // true if handled
+    bool onWrite(Emulator& /*emu*/, unsigned short /*address*/, short /*value*/) { return false; }
+};
+
+struct HostDevices : NoHooks {
+    static const bool hostDevices = true;
+};
+
 class Emulator {
+public:
+    enum StopReason { stopHalt, stopPc, stopCycles };
+    enum PerfCounter { perfRetired, perfCycles, perfBranches, perfReads, perfWrites, perfInterrupts, perfCount };
+
+    // cpu 0 and memory, enough to rewind a run
+    struct Snapshot {
+        vector<char> mem;
+        short reg[8];
+        unsigned short pageTable[16];
+        short psw;
+        short interrupts;
+        short irqMask;
+        char irqPriority[8];
+        short interval;
+        unsigned long long retired;
+        unsigned long long perf[perfCount];
+        unsigned long long perfStart[perfCount];
+        unsigned long long perfLatch[perfCount];
+        unsigned long long storeCount;
+        bool running;
+        // devices
+        short termIn;
+        unsigned char route[8];
+        unsigned short blkSector, blkBuffer;
+        short blkStatus;
+        unsigned short dmaSrc, dmaDst, dmaLen;
+    };
+
 private:
+    struct Shared { // state shared between all cpus in smp mode
+        vector<char> mem;           // physical memory, at least 64KiB
+        atomic<short> termIn{0};
+        atomic<short> interval{-1}; // timer configuration, any cpu may write it
+        mutex xchgLock;
+        atomic<bool> stop{false};
+        atomic<unsigned char> route[8] = {}; // interrupt line -> cpu, up to 256 of them
+        mutex wakeLock;             // cpus blocked in wait sleep on wake
+        condition_variable wake;
+        vector<Emulator*> cpus;
+        BlockDevice disk;
+        mutex diskLock;             // one transfer at a time
+        atomic<unsigned short> blkSector{0};
+        atomic<unsigned short> blkBuffer{0};
+        atomic<short> blkStatus{0};
+        atomic<unsigned short> dmaSrc{0};
+        atomic<unsigned short> dmaDst{0};
+        atomic<unsigned short> dmaLen{0};
+        int dmaCost = 1;            // cycles charged per word moved
+        bool semihosting = false;
+        atomic<int> exitStatus{0};
+    };
+
     string memFile;
 
-    char mem[1 << 16];
-    bool running;
+    shared_ptr<Shared> shared;
+
+    // Paging mmu: the 64KiB address space is 16 pages of 4KiB, each mapped to any
+    // frame of physical memory through a page table register. pageBase caches the
+    // host address of every mapped frame so translation is a single lookup.
+    static const int pageCount = 16;
+    static const size_t pageSize = 1 << 12;
+    unsigned short pageTable[pageCount];
+    char* pageBase[pageCount];
+    atomic<bool> running{false};
+    unsigned long long retired = 0; // instructions executed
+    Coverage* coverage = nullptr;
+    Cache* cache = nullptr;     // sees every memory access when set, single cpu only
+    EventLog* events = nullptr; // records or replays terminal and timer events, single cpu only
+    int cpuId = 0;
+    int cpuCount = 1;
+
+    // performance counters, perf[perfRetired] is unused since retired already counts
+    // instructions and memory accesses are added to perf[perfCycles] when it is read
+    unsigned long long perf[perfCount] = {};
+    unsigned long long perfStart[perfCount] = {};   // values at the last reset
+    unsigned long long perfLatch[perfCount] = {};   // what the guest reads
+
+    // idle loop detection
+    static const unsigned short idleLoopMax = 32; // longest loop body in bytes
+    bool idleDetect = false;    // single cpu only, stores of other cpus are not seen
+    bool ownsDevices = false;   // true when run() polls the terminal and timer
+    unsigned long long storeCount = 0;
+    bool ioRead = false;
+    short loopHead = 0;
+    unsigned long long loopStores = 0;
+    short loopPsw = 0;
+    short loopReg[7];
 
     struct pswStruct {
         bool Z = false;
@@ -23,26 +137,101 @@ private:
     };
 
     short reg[8];
+    short badReg = 0;   // target of accesses to registers that don't exist
+    // psw as register 8, loaded on the first access in an instruction and stored
+    // back by storePswReg() once the instruction is done if it was changed
+    short pswReg = 0;
+    short pswRegLoaded = 0;
+    bool pswRegUsed = false;
     short& pc = reg[7];
     short& sp = reg[6];
     pswStruct psw;
-    short interrupts = 0;
+
+    // Condition flags are not computed by the instructions that set them. The last
+    // flag setting operation is recorded instead and psw is brought up to date by
+    // materializeFlags() when something actually reads it.
+    enum FlagOp : char { flagsNone, flagsAdd, flagsSub, flagsTest, flagsShl, flagsShr };
+    FlagOp flagOp = flagsNone;
+    short flagA = 0;
+    short flagB = 0;
+    short flagRes = 0;
+
+    // interrupt controller, one bit per ivt entry
+    atomic<short> interrupts{0};    // pending lines
+    short irqMask = 0;              // lines masked by the guest
+    char irqPriority[8] = {0, 1, 2, 3, 4, 5, 6, 7}; // lower value is served first
+    // device hooks bound by step() and runUntil() for the duration of the call
+    struct DeviceHooks {
+        void* hooks = nullptr;
+        bool (*read)(void* hooks, Emulator& emu, unsigned short address, short& value) = nullptr;
+        bool (*write)(void* hooks, Emulator& emu, unsigned short address, short value) = nullptr;
+    };
+    DeviceHooks devices;
+
+    // binds the device hooks and puts back whatever was bound before on the way out
+    template<class Hooks>
+    struct DeviceBinding {
+        Emulator& emu;
+        DeviceHooks saved;
+        DeviceBinding(Emulator& emu, Hooks& hooks);
+        ~DeviceBinding() { emu.devices = saved; }
+    };
+
     long long int time;
-    short interval = -1;
+    long long int prevTime = 0;
+
+    Emulator(shared_ptr<Shared> shared, int cpuId, int cpuCount, bool idleDetect);
 
+    char& at(unsigned short address) { return pageBase[address >> 12][address & (pageSize - 1)]; }
+    size_t physical(unsigned short address) { return &at(address) - shared->mem.data(); }
+    // Aligned data words are little endian in memory, like the host, and are loaded and
+    // stored atomically so xchg stays atomic against the plain accesses of other cpus.
+    typedef short __attribute__((may_alias)) Word;
+    static bool atomicWord(unsigned short address) { return !(address & 1) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__; }
+    Word* wordAt(unsigned short address) { return (Word*)&at(address); }
+    bool mapPage(int page, unsigned short frame);
+    void resetPages();
+    char fetch();
+    short& regAt(char n);
     short readWord(short address, bool isData);
     void writeWord(short word, short address, bool isData);
+    short readIO(unsigned short address);
+    void writeIO(short word, unsigned short address);
     short pop();
     void push(short dat);
     short getOperand(short payload, char regN, char adType);
     void setOperand(short payload, char dRegN, char sRegN, char adType);
     void updateRegPre(char type, char regN);
     void updateRegPost(char type, char regN);
+    template<class Hooks> void execute(Hooks& hooks);
+    template<class Hooks> void runLoop(Hooks& hooks);
+    void run();
+    void runSmp();
     void processInstruction();
+    void setFlags(FlagOp op, short a, short b, short res) {
+        if(op != flagsAdd && op != flagsSub) materializeFlags(); // C and O of the pending op survive a partial one
+        flagOp = op; flagA = a; flagB = b; flagRes = res;
+    }
+    void materializeFlags();
+    void storePswReg();
     void timer();
     void getUserInput();
+    void pollDevices();
+    void deliver(const EventLog::Event& event);
+    int timerPeriod();
+    void raiseInterrupt(int line);
+    void waitForInterrupt();
+    void checkIdleLoop();
     void setupTerminal();
     void handleInterrupts();
+    void enterInterrupt(int line);
+    short maskedLines();
+    void blockCommand(short cmd);
+    void dmaCommand(short mode);
+    void fillMemory(unsigned short address, char value, size_t len);
+    void semihost();
+    void perfCommand(short cmd);
+    string readString(unsigned short address);
 
     static const char imm = 0;
     static const char regDir = 1;
@@ -51,9 +240,162 @@ private:
     static const char regIndDisp = 3;
     static const char memDir = 4;
 
+    // memory mapped registers
+    static const unsigned short ioStart = 0xff00;
+    static const unsigned short termOut = 0xff00;
+    static const unsigned short termIn = 0xff02;
+    static const unsigned short timCfg = 0xff10;
+    static const unsigned short cpuIdReg = 0xff20;   // read: id of the cpu doing the read
+    static const unsigned short cpuCountReg = 0xff22; // read: number of cpus
+    static const unsigned short irqRoute = 0xff24;   // write: (cpu << 8) | line
+    static const unsigned short irqPriorityReg = 0xff26; // write: (line << 8) | priority
+    static const unsigned short irqMaskReg = 0xff28;     // read/write: bit set masks the line
+    static const unsigned short blkSectorReg = 0xff30;   // read/write: sector to transfer
+    static const unsigned short blkBufferReg = 0xff32;   // read/write: guest address of the sector buffer
+    static const unsigned short blkCmdReg = 0xff34;      // write: command, read: status of the last one
+    static const unsigned short blkCountReg = 0xff36;    // read: number of sectors on the disk
+    static const unsigned short dmaSrcReg = 0xff38;      // read/write: source address, fill byte in fill mode
+    static const unsigned short dmaDstReg = 0xff3a;      // read/write: destination address
+    static const unsigned short dmaLenReg = 0xff3c;      // read/write: length in bytes
+    static const unsigned short dmaCtlReg = 0xff3e;      // write: mode, starts the transfer
+    static const unsigned short pageTableReg = 0xff40;   // read/write: 16 words, frame of every page
+    static const unsigned short perfCtlReg = 0xff60;     // write: 1 latches the counters, 2 resets them
+    static const unsigned short perfReg = 0xff62;        // read: latched counters, low word first
+
+    // block device commands and status
+    static const short blkRead = 1;     // sector -> buffer
+    static const short blkWrite = 2;    // buffer -> sector
+    static const short blkDone = 0;
+    static const short blkError = 1;
+
+    // dma modes
+    static const short dmaCopy = 1;
+    static const short dmaFill = 2;
+
+    // performance counter commands
+    static const short perfLatchCmd = 1;
+    static const short perfResetCmd = 2;
+
+    // ivt entries
+    static const int errorLine = 1;
+    static const int timerLine = 2;
+    static const int terminalLine = 3;
+    static const int blockLine = 4;
+    static const int dmaLine = 5;
+    static const int semihostLine = 7;  // int on this line traps to the host when semihosting
+
+    // semihosting operations, r0 selects one, arguments in r1-r3, result in r0
+    static const short shWrite = 1;     // r1 buffer, r2 length: to stdout
+    static const short shWriteFile = 2; // r1 path, r2 buffer, r3 length: create or truncate the file
+    static const short shReadFile = 3;  // r1 path, r2 buffer, r3 max length
+    static const short shTime = 4;      // seconds since the epoch in r1:r0, milliseconds in r2
+    static const short shExit = 5;      // r1 status, stops every cpu
+
 public:
-    Emulator(string memFile) : memFile(memFile) {}
+    Emulator(string memFile, int cpuCount = 1, bool idleDetect = false, size_t memSize = 1 << 16);
+    Emulator() : Emulator("") {}
     void startEmulation();
+    void emulate();     // runs whatever image is loaded on the terminal, like startEmulation
+    void setCoverage(Coverage* coverage) { this->coverage = coverage; }
+    void setCache(Cache* cache) { this->cache = cache; }
+    void setEventLog(EventLog* events) { this->events = events; }
+    bool attachDisk(const string& file) { return shared->disk.open(file); }
+    void setDmaCost(int cyclesPerWord) { shared->dmaCost = cyclesPerWord; }
+    void setSemihosting(bool enabled) { shared->semihosting = enabled; }
+    int getExitStatus() { return shared->exitStatus; }
+
+    // embedding api, always drives cpu 0
+    bool loadImage(const char* image, size_t size); // flat 64KiB image or segmented (SSEG)
+    bool loadImage(const string& file);
+    void reset();
+    int step(int n = 1);
+    template<class Hooks> int step(int n, Hooks& hooks);
+    StopReason runUntil(int pcLimit, unsigned long long cycleLimit = ~0ULL);
+    template<class Hooks> StopReason runUntil(int pcLimit, unsigned long long cycleLimit, Hooks& hooks);
+
+    bool isRunning() { return running; }
+    unsigned long long getCycles() { return retired; }
+    unsigned long long getPerfCounter(PerfCounter counter);
+    short getReg(int n) { return reg[n & 0x7]; }
+    void setReg(int n, short value) { reg[n & 0x7] = value; }
+    short getPsw();
+    void setPsw(short pswW);
+    void readMemory(unsigned short address, char* out, size_t len);
+    void writeMemory(unsigned short address, const char* data, size_t len);
+    void saveSnapshot(Snapshot& snap);
+    void restoreSnapshot(const Snapshot& snap);
 };
 
-#endif
\ No newline at end of file
+inline short& Emulator::regAt(char n) {
+    if((unsigned char)n < 8) return reg[(unsigned char)n];
+    if(n == 8) {    // psw, the assembler encodes it as register 8
+        if(!pswRegUsed) {
+            pswReg = pswRegLoaded = getPsw();
+            pswRegUsed = true;
+        }
+        return pswReg;
+    }
+    interrupts |= 1 << errorLine;   // no such register
+    return badReg;
+}
+
+template<class Hooks>
+void Emulator::execute(Hooks& hooks) {
+    unsigned short from = pc;
+    char inst = Hooks::retire ? at(from) : 0;
+    if(Hooks::trace) hooks.onInstruction(*this, from);
+    processInstruction();
+    if(pswRegUsed) storePswReg();
+    retired++;
+    if(Hooks::retire) hooks.onRetire(*this, from, inst);
+    if(Hooks::hostDevices) pollDevices();
+    if(interrupts) handleInterrupts();
+}
+
+template<class Hooks>
+void Emulator::runLoop(Hooks& hooks) {
+    while(running && !shared->stop) execute(hooks);
+}
+
+template<class Hooks>
+Emulator::DeviceBinding<Hooks>::DeviceBinding(Emulator& emu, Hooks& hooks) : emu(emu), saved(emu.devices) {
+    if(!Hooks::devices) return;
+    emu.devices.hooks = &hooks;
+    emu.devices.read = [](void* h, Emulator& e, unsigned short address, short& value) {
+        return static_cast<Hooks*>(h)->onRead(e, address, value);
+    };
+    emu.devices.write = [](void* h, Emulator& e, unsigned short address, short value) {
+        return static_cast<Hooks*>(h)->onWrite(e, address, value);
+    };
+}
+
+template<class Hooks>
+int Emulator::step(int n, Hooks& hooks) {
+    DeviceBinding<Hooks> binding(*this, hooks);
+    int done = 0;
+    while(done < n && running) {
+        execute(hooks);
+        done++;
+    }
+    return done;
+}
+
+template<class Hooks>
+Emulator::StopReason Emulator::runUntil(int pcLimit, unsigned long long cycleLimit, Hooks& hooks) {
+    DeviceBinding<Hooks> binding(*this, hooks);
+    StopReason reason = stopHalt;
+    while(running) {
+        if((unsigned short)pc == pcLimit) {
+            reason = stopPc;
+            break;
+        }
+        if(retired >= cycleLimit) {
+            reason = stopCycles;
+            break;
+        }
+        execute(hooks);
+    }
+    return reason;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+#include <string>
+#include <fstream>
+#include <deque>
+
+using namespace std;
+
+// External events tagged with the retired instruction count they were delivered
+// at. Recording writes them as they happen, replaying hands them back at the same
+// counts so a run with interrupts can be repeated exactly.
+class EventLog {
+public:
+    static const char timerTick = 'T';
+    static const char input = 'I';
+
+    struct Event {
+        unsigned long long retired;
+        char type;
+        char value;
+    };
+
+private:
+    ofstream out;
+    deque<Event> pending;   // replay: events not delivered yet
+    bool replayMode = false;
+
+public:
+    bool record(const string& file);
+    bool replay(const string& file);
+    bool replaying() { return replayMode; }
+    bool recording() { return out.is_open(); }
+    void log(unsigned long long retired, char type, char value = 0);
+    bool next(unsigned long long retired, Event& event);   // next event due at retired, if any
+    bool nextAny(Event& event);                            // next event whatever its count
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+#include <string>
+#include <map>
+
+using namespace std;
+
+// Section and symbol names from the linker's text output, used to put names on
+// guest addresses in reports
+class Symbols {
+private:
+    map<unsigned short, string> symbols;    // address -> name
+    map<unsigned short, pair<string, size_t>> sections; // address -> name, size
+
+public:
+    bool load(const string& listing);
+    bool empty() { return symbols.empty() && sections.empty(); }
+    string symbolAt(unsigned short address);    // closest symbol at or below, "?" if none
+    string symbolize(unsigned short address);   // symbol+0xoffset
+    string sectionAt(unsigned short address);   // "?" outside every section
+};
+
+#endif
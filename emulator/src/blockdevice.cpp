@@ -0,0 +1,40 @@
+#include "../inc/blockdevice.h"
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool BlockDevice::open(const string& file) {
+    close();
+    fd = ::open(file.c_str(), O_RDWR);
+    if(fd < 0) {
+        cout << file << " could not be opened!" << endl;
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sectorSize) {
+        cout << file << " is smaller than one sector!" << endl;
+        close();
+        return false;
+    }
+
+    size = st.st_size - st.st_size % sectorSize; // a partial sector at the end is not visible
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapped == MAP_FAILED) {
+        cout << file << " could not be mapped!" << endl;
+        close();
+        return false;
+    }
+    data = (char*)mapped;
+    return true;
+}
+
+void BlockDevice::close() {
+    if(data) munmap(data, size);
+    if(fd >= 0) ::close(fd);
+    data = nullptr;
+    size = 0;
+    fd = -1;
+}
@@ -0,0 +1,122 @@
+#include "../inc/cache.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+static bool powerOfTwo(size_t n) {
+    return n && !(n & (n - 1));
+}
+
+bool Cache::configure(size_t size, int ways, int lineSize) {
+    if(!powerOfTwo(size) || !powerOfTwo(ways) || !powerOfTwo(lineSize) || (size_t)ways * lineSize > size) {
+        cout << "Cache size, ways and line size must be powers of two with ways * line <= size!" << endl;
+        return false;
+    }
+    this->size = size;
+    this->ways = ways;
+    this->lineSize = lineSize;
+    sets = size / ((size_t)ways * lineSize);
+    clear();
+    return true;
+}
+
+void Cache::access(unsigned short address, size_t physical) {
+    size_t line = physical / lineSize;
+    Way* set = &lines[(line % sets) * ways];
+    clock++;
+
+    size_t frame = physical / frameSize;
+    if(frame >= frameAccesses.size()) {
+        frameAccesses.resize(frame + 1);
+        frameMisses.resize(frame + 1);
+    }
+    accessesAt[address]++;
+    frameAccesses[frame]++;
+
+    Way* victim = set;
+    for(int i = 0; i < ways; i++) {
+        if(set[i].valid && set[i].tag == line) {
+            set[i].lastUse = clock;
+            hits++;
+            return;
+        }
+        if(!set[i].valid || (victim->valid && set[i].lastUse < victim->lastUse)) victim = &set[i];
+    }
+
+    misses++;
+    missesAt[address]++;
+    frameMisses[frame]++;
+    victim->tag = line;
+    victim->valid = true;
+    victim->lastUse = clock;
+}
+
+static string missRate(unsigned long long accesses, unsigned long long misses) {
+    stringstream ss;
+    ss << fixed << setprecision(2) << (accesses ? 100.0 * misses / accesses : 0.0) << "%";
+    return ss.str();
+}
+
+bool Cache::write(const string& file) {
+    ofstream out(file, ofstream::out | ofstream::trunc);
+    if(!out.is_open()) {
+        cout << "Couldn't open cache report file!" << endl;
+        return false;
+    }
+
+    out << "CACHE " << size << " bytes, " << ways << " ways, " << lineSize << " byte lines, "
+        << sets << " sets" << endl
+        << "ACCESSES " << hits + misses << " HITS " << hits << " MISSES " << misses
+        << " MISS RATE " << missRate(hits + misses, misses) << endl;
+
+    // group the per address counts by section and by symbol
+    map<string, pair<unsigned long long, unsigned long long>> bySection, bySymbol;
+    for(int addr = 0; addr < 1 << 16; addr++) {
+        if(!accessesAt[addr]) continue;
+        auto& se = bySection[symbols.sectionAt(addr)];
+        se.first += accessesAt[addr];
+        se.second += missesAt[addr];
+        auto& sym = bySymbol[symbols.symbolAt(addr)];
+        sym.first += accessesAt[addr];
+        sym.second += missesAt[addr];
+    }
+
+    out << endl << "SECTIONS" << endl;
+    out << left << setw(14) << "NAME" << setw(12) << "ACCESSES" << setw(12) << "MISSES" << "MISS RATE" << endl;
+    for(auto& se : bySection) {
+        out << left << setw(14) << se.first << setw(12) << se.second.first << setw(12) << se.second.second
+            << missRate(se.second.first, se.second.second) << endl;
+    }
+
+    out << endl << "SYMBOLS" << endl;
+    out << left << setw(14) << "NAME" << setw(12) << "ACCESSES" << setw(12) << "MISSES" << "MISS RATE" << endl;
+    for(auto& sym : bySymbol) {
+        out << left << setw(14) << sym.first << setw(12) << sym.second.first << setw(12) << sym.second.second
+            << missRate(sym.second.first, sym.second.second) << endl;
+    }
+
+    // one line per touched physical frame, the bar is scaled to the busiest one
+    out << endl << "HEATMAP" << endl;
+    out << left << setw(10) << "FRAME" << setw(12) << "ACCESSES" << setw(12) << "MISSES" << endl;
+    unsigned long long busiest = frameAccesses.empty() ? 0 : *max_element(frameAccesses.begin(), frameAccesses.end());
+    for(size_t frame = 0; frame < frameAccesses.size(); frame++) {
+        if(!frameAccesses[frame]) continue;
+        out << left << hex << setw(10) << frame * frameSize << dec << setw(12) << frameAccesses[frame]
+            << setw(12) << frameMisses[frame] << string((frameAccesses[frame] * 40 + busiest - 1) / busiest, '#') << endl;
+    }
+    return true;
+}
+
+void Cache::clear() {
+    lines.assign(sets * ways, Way());
+    clock = 0;
+    hits = 0;
+    misses = 0;
+    fill(accessesAt.begin(), accessesAt.end(), 0);
+    fill(missesAt.begin(), missesAt.end(), 0);
+    frameAccesses.clear();
+    frameMisses.clear();
+}
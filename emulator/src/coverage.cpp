@@ -0,0 +1,29 @@
+#include "../inc/coverage.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+bool Coverage::write(const string& file) {
+    ofstream out(file, ofstream::out | ofstream::trunc);
+    if(!out.is_open()) {
+        cout << "Couldn't open coverage file!" << endl;
+        return false;
+    }
+
+    // one line per executed address: ADDRESS SYMBOL+OFFSET FLAGS
+    // X executed, T conditional jump taken, N conditional jump not taken
+    for(int addr = 0; addr < 1 << 16; addr++) {
+        unsigned char bits = bitmap[addr];
+        if(!bits) continue;
+        out << hex << setw(4) << setfill('0') << addr << " " << symbols.symbolize(addr) << " "
+            << ((bits & executed) ? "X" : "")
+            << ((bits & taken) ? "T" : "")
+            << ((bits & notTaken) ? "N" : "")
+            << endl;
+    }
+    return true;
+}
+
+void Coverage::clear() {
+    fill(bitmap, bitmap + (1 << 16), 0);
+}
@@ -1,244 +1,478 @@
 #include "../inc/emulator.h"
+#include "../inc/coverage.h"
+#include "../inc/cache.h"
+#include "../../common/inc/isa.h"
 #include <iostream>
 #include <termios.h>
 #include <unistd.h>
 #include <signal.h>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <poll.h>
+#include <cstring>
+
+Emulator::Emulator(string memFile, int cpuCount, bool idleDetect, size_t memSize) 
+    : memFile(memFile), shared(make_shared<Shared>()), cpuCount(cpuCount), idleDetect(idleDetect && cpuCount == 1) {
+    shared->mem.resize(max(memSize, (size_t)1 << 16) & ~(size_t)(pageSize - 1));
+    shared->cpus.push_back(this);
+    resetPages();
+}
+
+Emulator::Emulator(shared_ptr<Shared> shared, int cpuId, int cpuCount, bool idleDetect) 
+    : shared(shared), cpuId(cpuId), cpuCount(cpuCount), idleDetect(idleDetect && cpuCount == 1) {
+    resetPages();
+}
 
 void Emulator::startEmulation() {
     //cout << hex << "Emulation start" << endl;
-    ifstream in(memFile, ios::binary);  // load memory
-    if(in.fail()) {
+    if(!loadImage(memFile)) {
         //cout << memFile << " could not be opened!" << endl;
         return;
     }
-    for(int i = 0; i < 1 << 16; i++) {
-        in.read((char*)&mem[i], sizeof(char));
+    emulate();
+}
+
+void Emulator::emulate() {
+    reset();
+    setupTerminal();
+
+    if(cpuCount > 1) {
+        runSmp();
+    } else {
+        run();
     }
 
+    cout << endl;
+}
+
+bool Emulator::loadImage(const string& file) {
+    ifstream in(file, ios::binary | ios::ate);  // load memory
+    if(in.fail()) {
+        return false;
+    }
+    vector<char> image(in.tellg());
+    in.seekg(0);
+    in.read(image.data(), image.size());
+    return loadImage(image.data(), image.size());
+}
+
+bool Emulator::loadImage(const char* image, size_t size) {
+    vector<char>& mem = shared->mem;    // images hold physical addresses
+    fill(mem.begin(), mem.end(), 0);
+
+    if(size < 8 || string(image, 4) != "SSEG") { // flat image
+        copy(image, image + min(size, mem.size()), mem.begin());
+        return true;
+    }
+
+    // segmented: "SSEG", count, then address, size and data of every segment,
+    // segments with zeroFill set in the size have no data
+    static const uint32_t zeroFill = 1u << 31;
+    uint32_t count;
+    size_t pos = 4;
+    memcpy(&count, image + pos, sizeof(count));
+    pos += sizeof(count);
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t address, len;
+        if(pos + sizeof(address) + sizeof(len) > size) return false;
+        memcpy(&address, image + pos, sizeof(address));
+        memcpy(&len, image + pos + sizeof(address), sizeof(len));
+        pos += sizeof(address) + sizeof(len);
+        if(len & zeroFill) {
+            len &= ~zeroFill;
+            if((size_t)address + len > mem.size()) return false;
+            memset(mem.data() + address, 0, len);
+            continue;
+        }
+        if(pos + len > size || (size_t)address + len > mem.size()) return false;
+        memcpy(mem.data() + address, image + pos, len);
+        pos += len;
+    }
+    return true;
+}
+
+void Emulator::reset() {
     // init values
     pc = readWord(0, true);
     sp = 0xff;
     reg[0] = 0;
     reg[1] = 1;
-    setupTerminal();
+    psw = pswStruct();
+    flagOp = flagsNone;
+    interrupts = 0;
+    retired = 0;
+    resetPages();
+    fill(perf, perf + perfCount, 0);
+    fill(perfStart, perfStart + perfCount, 0);
+    fill(perfLatch, perfLatch + perfCount, 0);
     running = true;
+}
 
-    while(running) {    // main loop
-        //cout << hex << (int)pc << endl;
-        processInstruction();
+void Emulator::run() {
+    if(cpuCount > 1) {  // in smp mode devices are polled by runSmp
+        if(coverage) {
+            CoverageHooks<NoHooks> hooks(*coverage);
+            runLoop(hooks);
+        } else {
+            NoHooks hooks;
+            runLoop(hooks);
+        }
+    } else {
+        ownsDevices = true;
+        if(coverage) {
+            CoverageHooks<HostDevices> hooks(*coverage);
+            runLoop(hooks);
+        } else {
+            HostDevices hooks;
+            runLoop(hooks);
+        }
+    }
+}
+
+int Emulator::step(int n) {
+    NoHooks hooks;
+    return step(n, hooks);
+}
+
+Emulator::StopReason Emulator::runUntil(int pcLimit, unsigned long long cycleLimit) {
+    NoHooks hooks;
+    return runUntil(pcLimit, cycleLimit, hooks);
+}
+
+void Emulator::saveSnapshot(Snapshot& snap) {
+    snap.mem = shared->mem;
+    copy(reg, reg + 8, snap.reg);
+    copy(pageTable, pageTable + pageCount, snap.pageTable);
+    snap.psw = getPsw();
+    snap.interrupts = interrupts;
+    snap.irqMask = irqMask;
+    copy(irqPriority, irqPriority + 8, snap.irqPriority);
+    snap.interval = shared->interval;
+    snap.retired = retired;
+    copy(perf, perf + perfCount, snap.perf);
+    copy(perfStart, perfStart + perfCount, snap.perfStart);
+    copy(perfLatch, perfLatch + perfCount, snap.perfLatch);
+    snap.storeCount = storeCount;
+    snap.running = running;
+    snap.termIn = shared->termIn;
+    for(int i = 0; i < 8; i++) snap.route[i] = shared->route[i];
+    snap.blkSector = shared->blkSector;
+    snap.blkBuffer = shared->blkBuffer;
+    snap.blkStatus = shared->blkStatus;
+    snap.dmaSrc = shared->dmaSrc;
+    snap.dmaDst = shared->dmaDst;
+    snap.dmaLen = shared->dmaLen;
+}
+
+void Emulator::restoreSnapshot(const Snapshot& snap) {
+    copy(snap.mem.begin(), snap.mem.end(), shared->mem.begin());
+    copy(snap.reg, snap.reg + 8, reg);
+    for(int i = 0; i < pageCount; i++) {
+        mapPage(i, snap.pageTable[i]);
+    }
+    setPsw(snap.psw);
+    interrupts = snap.interrupts;
+    irqMask = snap.irqMask;
+    copy(snap.irqPriority, snap.irqPriority + 8, irqPriority);
+    shared->interval = snap.interval;
+    retired = snap.retired;
+    copy(snap.perf, snap.perf + perfCount, perf);
+    copy(snap.perfStart, snap.perfStart + perfCount, perfStart);
+    copy(snap.perfLatch, snap.perfLatch + perfCount, perfLatch);
+    storeCount = snap.storeCount;
+    running = snap.running;
+    shared->termIn = snap.termIn;
+    for(int i = 0; i < 8; i++) shared->route[i] = snap.route[i];
+    shared->blkSector = snap.blkSector;
+    shared->blkBuffer = snap.blkBuffer;
+    shared->blkStatus = snap.blkStatus;
+    shared->dmaSrc = snap.dmaSrc;
+    shared->dmaDst = snap.dmaDst;
+    shared->dmaLen = snap.dmaLen;
+}
+
+void Emulator::resetPages() {
+    for(int i = 0; i < pageCount; i++) {
+        mapPage(i, i);
+    }
+}
+
+bool Emulator::mapPage(int page, unsigned short frame) {
+    if((size_t)(frame + 1) * pageSize > shared->mem.size()) return false;
+    pageTable[page] = frame;
+    pageBase[page] = shared->mem.data() + (size_t)frame * pageSize;
+    return true;
+}
+
+// both copy a page at a time, frames of neighbouring pages need not be adjacent
+void Emulator::readMemory(unsigned short address, char* out, size_t len) {
+    while(len > 0) {
+        size_t chunk = min(len, pageSize - (address & (pageSize - 1)));
+        memcpy(out, &at(address), chunk);
+        address += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+}
+
+void Emulator::writeMemory(unsigned short address, const char* data, size_t len) {
+    while(len > 0) {
+        size_t chunk = min(len, pageSize - (address & (pageSize - 1)));
+        memcpy(&at(address), data, chunk);
+        address += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void Emulator::runSmp() {
+    // every cpu starts from the reset vector, guests tell them apart by reading cpuIdReg
+    vector<unique_ptr<Emulator>> secondary;
+    for(int i = 1; i < cpuCount; i++) {
+        secondary.emplace_back(new Emulator(shared, i, cpuCount, idleDetect));
+        secondary.back()->coverage = coverage;
+        secondary.back()->reset();
+        shared->cpus.push_back(secondary.back().get());
+    }
+
+    vector<thread> threads;
+    for(auto cpu : shared->cpus) {
+        threads.emplace_back(&Emulator::run, cpu);
+    }
+
+    // this thread owns the devices and routes their interrupts
+    bool anyRunning = true;
+    while(anyRunning && !shared->stop) {
         timer();
         getUserInput();
-        handleInterrupts();
+        this_thread::sleep_for(chrono::milliseconds(1));
+
+        anyRunning = false;
+        for(auto cpu : shared->cpus) {
+            if(cpu->running) anyRunning = true;
+        }
     }
 
-    cout << endl;
+    for(auto& t : threads) {
+        t.join();
+    }
+}
+
+char Emulator::fetch() {
+    if(cache && cache->fetches) cache->access(pc, physical(pc));
+    return at(pc++);
 }
 
 void Emulator::processInstruction() {
-    char inst = mem[pc++];
-    char op = (inst >> 4) & 0xf;
+    char inst = fetch();
     char mod = inst & 0xf;
-    
 
-    //cout << (int)op << endl;
+    const isa::Instruction* in = isa::decode(inst);
+    if(!in) { // invalid instruction
+        enterInterrupt(errorLine);
+        return;
+    }
+    perf[perfCycles] += in->cycles;
+
+    // the form says which operand bytes follow, the same for every instruction of a form
+    char regD = in->form == isa::noOper ? 0 : fetch();
+    char sRegN = regD & 0xf;
+    char dRegN = (regD >> 4) & 0xf;
+    char upT = 0;
+    char adT = 0;
+    short payload = 0;
+    if(in->form == isa::jump || in->form == isa::load) {
+        char upAddrT = fetch();
+        upT = (upAddrT >> 4) & 0xf;
+        adT = upAddrT & 0xf;
+        if(isa::hasPayload(adT)) {
+            payload = readWord(pc, false);
+            pc+=2;
+        }
+    }
 
-    switch(op) {
-        case 0x0: { // halt
-            //cout << endl << "HALT" << endl;
+    switch(in->exec) {
+        case isa::execHalt:
             running = false;
             return;
-        }
-        case 0x1: { // int
-            pc++;
-            // TODO: push psw; pc<=mem16[(reg[DDDD] mod 8)*2];
+        case isa::execInt: {
+            int line = regAt(dRegN) & 0x7;
+            if(line == semihostLine && shared->semihosting) {
+                semihost();
+                return;
+            }
+            enterInterrupt(line); // software interrupts can't be masked
             return;
         }
-        case 0x2: { // iret
+        case isa::execIret: {
             short pswW = pop();
             pc = pop();
-            //cout << "IRET TO: " << pc << endl << flush;
-            psw.I = false;//(pswW >> 15) & 0xf;
-            psw.T1 = false;//(pswW >> 14) & 0xf;
-            psw.Tr = false;//(pswW >> 13) & 0xf;
-            psw.N = false;//(pswW >> 3) & 0xf;
-            psw.C = false;//(pswW >> 2) & 0xf;
-            psw.O = false;//(pswW >> 1) & 0xf;
-            psw.Z = false;//(pswW >> 0) & 0xf;
-            //cout << "PSW: " << hex << pswW << endl << flush;
+            setPsw(pswW);
             return;
         }
-        case 0x3: { // call
-            //cout << endl << "CALL" << endl;
-            push(pc);
-            char regD = mem[pc++];
-            short sRegN = regD & 0xf;
-            char upAddrT = mem[pc++];
-            char upT = (upAddrT >> 4) & 0xf;
-            char adT = upAddrT & 0xf;
-            short payload;
-            if(adT == imm || adT ==  regIndDisp || adT == memDir) {
-                payload = readWord(pc, false);
-                pc+=2;
-            }
-            pc = getOperand(payload, sRegN, adT);             
+        case isa::execCall: {
+            short target = getOperand(payload, sRegN, adT);
+            push(pc);   // return to the instruction after the call
+            pc = target;
             return;
         }
-        case 0x4: { // ret
-            //cout << endl << "RET" << endl;
+        case isa::execRet:
             pc = pop();
             return;
+        case isa::execJump:
+            if(mod != 0) materializeFlags();
+            if(mod == 0 || (mod == 1 && psw.Z) || (mod == 2 && !psw.Z) || (mod == 3 && !psw.Z && psw.N == psw.O)) {
+                short from = pc;
+                pc = getOperand(payload, sRegN, adT);
+                perf[perfBranches]++;
+                if(idleDetect && (unsigned short)(from - pc) < idleLoopMax) checkIdleLoop();
+            }
+            return;
+        case isa::execXchg: {
+            if(mod == 1) { // xchg regD, [regS] - atomic so guests can build spinlocks
+                unsigned short addr = regAt(sRegN);
+                if(addr < ioStart && atomicWord(addr)) {
+                    perf[perfReads]++;
+                    perf[perfWrites]++;
+                    storeCount++;
+                    if(cache) cache->access(addr, physical(addr));
+                    regAt(dRegN) = __atomic_exchange_n(wordAt(addr), regAt(dRegN), __ATOMIC_ACQ_REL);
+                    return;
+                }
+                lock_guard<mutex> lock(shared->xchgLock);  // unaligned, only atomic against other xchg
+                short temp = readWord(addr, true);
+                writeWord(regAt(dRegN), addr, true);
+                regAt(dRegN) = temp;
+                return;
+            }
+
+            short temp = regAt(dRegN);
+            regAt(dRegN) = regAt(sRegN);
+            regAt(sRegN) = temp;
+            return;
         }
-        case 0x5: { // jmp, jeq, jne, jgt
-            //cout << endl << "JUMP" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char upAddrT = mem[pc++];
-            char upT = (upAddrT >> 4) & 0xf;
-            char adT = upAddrT & 0xf;
-            //cout << (int)adT << endl;
-            short payload = readWord(pc, false);
-            pc+=2;
-            if(mod == 0 | (mod == 1 && psw.Z) | (mod == 2 && !psw.Z) | (mod == 3 && psw.N)) pc = getOperand(payload, sRegN, adT);
+        case isa::execAdd: {
+            short a = regAt(dRegN);
+            short b = regAt(sRegN);
+            regAt(dRegN) = a + b;
+            setFlags(flagsAdd, a, b, regAt(dRegN));
             return;
         }
-        case 0x6: { // xchg
-            //cout << endl << "XCHG" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-
-            short temp = reg[sRegN];
-            reg[dRegN] = reg[sRegN];
-            reg[dRegN] = temp;
+        case isa::execSub: {
+            short a = regAt(dRegN);
+            short b = regAt(sRegN);
+            regAt(dRegN) = a - b;
+            setFlags(flagsSub, a, b, regAt(dRegN));
             return;
         }
-        case 0x7: { // add, sub, mul, div, cmp
-            //cout << endl << "ARITM" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-
-            switch(mod) {
-                case 0:
-                    reg[dRegN] += reg[sRegN];
-                    break;
-                case 1:
-                    reg[dRegN] -= reg[sRegN];
-                    break;
-                case 2:
-                    reg[dRegN] *= reg[sRegN];
-                    break;
-                case 3:
-                    reg[dRegN] /= reg[sRegN];
-                    break;
-                case 4:
-                    psw.N = (reg[dRegN] - reg[sRegN]) < 0;
-                    psw.Z = (reg[dRegN] - reg[sRegN]) == 0;
-                    break;
+        case isa::execMul:
+            regAt(dRegN) *= regAt(sRegN);
+            return;
+        case isa::execDiv: {
+            short b = regAt(sRegN);
+            if(b == 0) {
+                interrupts |= 1 << errorLine;
+                return;
             }
-
+            regAt(dRegN) = regAt(dRegN) / b;
             return;
         }
-        case 0x8: { // not, and, or, xor, test
-            //cout << endl << "LOGIC" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-
-            switch(mod) {
-                case 0:
-                    reg[dRegN] = ~reg[dRegN];
-                    break;
-                case 1:
-                    reg[dRegN] &= reg[sRegN];
-                    break;
-                case 2:
-                    reg[dRegN] |= reg[sRegN];
-                    break;
-                case 3:
-                    reg[dRegN] ^= reg[sRegN];
-                    break;
-                case 4:
-                    psw.N = (reg[dRegN] & reg[sRegN]) < 0;
-                    psw.Z = (reg[dRegN] & reg[sRegN]) == 0;
-                    break;
-            }
-
+        case isa::execCmp: {
+            short a = regAt(dRegN);
+            short b = regAt(sRegN);
+            setFlags(flagsSub, a, b, a - b);
             return;
         }
-        case 0x9: { // shl, shr
-            //cout << endl << "SHIFT" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-
-            switch(mod) {
-                case 0:
-                    reg[dRegN] <<= reg[sRegN];
-                    break;
-                case 1:
-                    reg[dRegN] >>= reg[sRegN];
-                    break;
-            }
-
+        case isa::execNot:
+            regAt(dRegN) = ~regAt(dRegN);
+            return;
+        case isa::execAnd:
+            regAt(dRegN) &= regAt(sRegN);
+            return;
+        case isa::execOr:
+            regAt(dRegN) |= regAt(sRegN);
+            return;
+        case isa::execXor:
+            regAt(dRegN) ^= regAt(sRegN);
+            return;
+        case isa::execTest:
+            setFlags(flagsTest, regAt(dRegN), regAt(sRegN), regAt(dRegN) & regAt(sRegN));
+            return;
+        case isa::execShl: {
+            short a = regAt(dRegN);
+            short b = regAt(sRegN);
+            regAt(dRegN) <<= b;
+            setFlags(flagsShl, a, b, regAt(dRegN));
+            return;
+        }
+        case isa::execShr: {
+            short a = regAt(dRegN);
+            short b = regAt(sRegN);
+            regAt(dRegN) >>= b;
+            setFlags(flagsShr, a, b, regAt(dRegN));
             return;
         }
-        case 0xa: { // ldr
-            //cout << endl << "LDR" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-            char upAddrT = mem[pc++];
-            char upT = (upAddrT >> 4) & 0xf;
-            char adT = upAddrT & 0xf;
-            short payload = 0;
-            if(adT == imm || adT ==  regIndDisp || adT == memDir) {
-                payload = readWord(pc, false);
-                pc+=2;
-            }            
-            //cout << hex << (int)regD << endl << flush; 
+        case isa::execLoad:
             updateRegPre(upT, sRegN);
-            reg[dRegN] = getOperand(payload, sRegN, adT);
+            regAt(dRegN) = getOperand(payload, sRegN, adT);
             updateRegPost(upT, sRegN);
-            //if(payload == 0x6a) mem[payload] = reg[dRegN] & 0xf;
             return;
-        }
-        case 0xb: { // str
-            //cout << endl << "STR" << endl;
-            char regD = mem[pc++];
-            char sRegN = regD & 0xf;
-            char dRegN = (regD >> 4) & 0xf;
-            //cout << hex << (int)regD << endl << flush;
-            char upAddrT = mem[pc++];
-            char upT = (upAddrT >> 4) & 0xf;
-            char adT = upAddrT & 0xf;
-            short payload = 0;
-            if(adT == imm || adT ==  regIndDisp || adT == memDir) {
-                payload = readWord(pc, false);
-                pc+=2;
-            }            
-            
+        case isa::execStore:
             updateRegPre(upT, sRegN);
             setOperand(payload, dRegN, sRegN, adT);
-            //if(payload == 0x6a) cout << "wait" << reg[dRegN] << endl << flush;
             updateRegPost(upT, sRegN);
             return;
-        }
+        case isa::execWait:
+            waitForInterrupt();
+            return;
     }
 }
 
+void Emulator::materializeFlags() {
+    unsigned short ua = flagA;
+    unsigned short ub = flagB;
+    switch(flagOp) {
+        case flagsNone:
+            return;
+        case flagsAdd:
+            psw.C = ua + ub > 0xffff;
+            psw.O = ((flagA ^ flagRes) & (flagB ^ flagRes)) < 0;
+            break;
+        case flagsSub:
+            psw.C = ua < ub; // borrow
+            psw.O = ((flagA ^ flagB) & (flagA ^ flagRes)) < 0;
+            break;
+        case flagsTest:
+            break;
+        case flagsShl: // C is the last bit shifted out
+            if(ub > 0) psw.C = ub <= 16 && ((ua >> (16 - ub)) & 1);
+            break;
+        case flagsShr:
+            if(ub > 0) psw.C = ub <= 16 ? ((flagA >> (ub - 1)) & 1) : flagA < 0;
+            break;
+    }
+    psw.Z = flagRes == 0;
+    psw.N = flagRes < 0;
+    flagOp = flagsNone;
+}
+
+void Emulator::storePswReg() {
+    pswRegUsed = false;
+    if(pswReg != pswRegLoaded) setPsw(pswReg);  // only reading it must not undo the flags just set
+}
+
 void Emulator::updateRegPre(char type, char regN) {
     switch(type) {
         case 0:
             return;
         case 1:
             //cout << "pre- " << (int)regN << endl << flush;
-            reg[regN] -= 2;
+            regAt(regN) -= 2;
             return;
         case 2:
             //cout << "pre+" << endl << flush;
-            reg[regN] += 2;
+            regAt(regN) += 2;
             return;
     }
 }
@@ -249,11 +483,11 @@ void Emulator::updateRegPost(char type, char regN) {
             return;
         case 3:
             //cout << "post-" << endl << flush;
-            reg[regN] -= 2;
+            regAt(regN) -= 2;
             return;
         case 4:
             //cout << "post+" << endl << flush;
-            reg[regN] += 2;
+            regAt(regN) += 2;
             return;
     }
 }
@@ -261,37 +495,40 @@ void Emulator::updateRegPost(char type, char regN) {
 void Emulator::setOperand(short payload, char dRegN, char sRegN, char adType) {
     switch(adType) {
         case regDir:
-            reg[dRegN] = reg[sRegN];
+            regAt(dRegN) = regAt(sRegN);
             break;
         case regInd:
-            writeWord(reg[dRegN], reg[sRegN], true);
+            writeWord(regAt(dRegN), regAt(sRegN), true);
             break;
         case regIndDisp:
-            writeWord(reg[dRegN], reg[sRegN] + payload, true);
+            writeWord(regAt(dRegN), regAt(sRegN) + payload, true);
             break;  
         case memDir:
-            //cout << "MEMDIR" << reg[dRegN] << " " << hex << payload << endl << flush;
-            writeWord(reg[dRegN], payload, true);
+            //cout << "MEMDIR" << regAt(dRegN) << " " << hex << payload << endl << flush;
+            writeWord(regAt(dRegN), payload, true);
             break;   
     }
 }
 
 short Emulator::getOperand(short payload, char regN, char adType) {
-    short ret;
+    short ret = 0;
     switch(adType) {
         case imm: 
             ret = payload;
             break;
         case regDir:
-            ret = reg[regN];
+            ret = regAt(regN);
             break;
         case regInd:
             //cout << "regInd" << endl << flush;
-            ret = readWord(reg[regN], true);
+            ret = readWord(regAt(regN), true);
             break;
         case regIndDisp:
-            ret = readWord(reg[regN] + payload, true);
+            ret = readWord(regAt(regN) + payload, true);
             break;  
+        case regDirDisp:    // pc relative jumps, relative to the next instruction
+            ret = regAt(regN) + payload;
+            break;
         case memDir:            
             ret = readWord(payload, true);
             //cout << "READ " << hex << payload  << ret << reg[1]<< endl << flush;
@@ -312,14 +549,17 @@ short Emulator::pop() {
     return ret;
 }
 
+int Emulator::timerPeriod() {
+    short interval = shared->interval;
+    return interval == 0 ? 500 : (interval == 1 ? 1000 : (interval == 2 ? 1500 : (interval == 3 ? 2000 : 
+                (interval == 4 ? 5000 : (interval == 5 ? 10000 : (interval == 6 ? 30000 : 60000))))));
+}
+
 void Emulator::timer() {
-    static long long int prevTime = 0;
     time = std::chrono::duration_cast<chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     //cout << hex << interval << endl << flush;
-    int intervalTime = interval == 0 ? 500 : (interval == 1 ? 1000 : (interval == 2 ? 1500 : (interval == 3 ? 2000 : 
-                            (interval == 4 ? 5000 : (interval == 5 ? 10000 : (interval == 6 ? 30000 : 60000))))));
-    if(time - prevTime > intervalTime && interval != -1) {
-        interrupts |= 4;
+    if(time - prevTime > timerPeriod() && shared->interval != -1) {
+        deliver({retired, EventLog::timerTick, 0});
         prevTime = time;
     }
 }
@@ -327,95 +567,405 @@ void Emulator::timer() {
 void Emulator::getUserInput() {
     char c;
     if(read(STDIN_FILENO, &c, 1) == 1) {
-        writeWord(c, 0xff00, true); // term in
-        interrupts |= 8; // entry 3
-        if(c == '`') running = false;
+        deliver({retired, EventLog::input, c});
     }
 }
 
-void Emulator::handleInterrupts() {
-    if(interrupts & 8) { // terminal interrupt
-        if(!psw.Tr) {
-            interrupts = 0;
-            short pswW;
-            pswW |= (short)psw.I << 15;
-            pswW |= (short)psw.T1 << 14;
-            pswW |= (short)psw.Tr << 13;
-            pswW |= (short)psw.N << 3;
-            pswW |= (short)psw.C << 2;
-            pswW |= (short)psw.O << 1;
-            pswW |= (short)psw.Z << 0;
-
-            push(pc);
-            push(pswW);
-            //cout << "INTERRUPT JUMP FROM: " << pc << endl << flush;
-            pc = readWord(6, true); // 3*2
-            //cout << "INTERRUPT JUMP TO: " << pc << endl << flush;
-            psw.I = true;
-            psw.Tr = true;
-            psw.T1 = true;
-        }
+void Emulator::pollDevices() {
+    if(events && events->replaying()) {
+        EventLog::Event event;
+        while(events->next(retired, event)) deliver(event);
+        return;
+    }
+    timer();
+    getUserInput();
+}
+
+void Emulator::deliver(const EventLog::Event& event) {
+    if(events && events->recording()) events->log(retired, event.type, event.value);
+    if(event.type == EventLog::timerTick) {
+        raiseInterrupt(timerLine);
+        return;
+    }
+    shared->termIn = event.value;
+    raiseInterrupt(terminalLine);
+    if(event.value == '`') shared->stop = true;
+}
+
+void Emulator::raiseInterrupt(int line) {
+    shared->cpus[shared->route[line]]->interrupts |= 1 << line;
+    if(cpuCount > 1) {
+        lock_guard<mutex> lock(shared->wakeLock);
+        shared->wake.notify_all();
     }
-    if(interrupts & 4) { // timer interrupt
-        //cout << "TAJMER" << endl << flush;
-        if(!psw.T1) {
-            interrupts = 0;
-            short pswW;
-            pswW |= (short)psw.I << 15;
-            pswW |= (short)psw.T1 << 14;
-            pswW |= (short)psw.Tr << 13;
-            pswW |= (short)psw.N << 3;
-            pswW |= (short)psw.C << 2;
-            pswW |= (short)psw.O << 1;
-            pswW |= (short)psw.Z << 0;
-
-            push(pc);
-            push(pswW);
-            //cout << "TIMER TICK " << pc << endl << flush;
-            pc = readWord(4, true); // 2*2
-            //cout << "INTERRUPT JUMP TO: " << pc << endl << flush;
-            psw.I = true;
-            psw.Tr = true;
-            psw.T1 = true;
+}
+
+void Emulator::waitForInterrupt() {
+    if(cpuCount == 1 && !ownsDevices) return; // embedded, nothing could wake us up
+    while(!interrupts && !shared->stop) {
+        if(cpuCount > 1) {  // devices belong to runSmp, sleep until it raises something
+            unique_lock<mutex> lock(shared->wakeLock);
+            shared->wake.wait_for(lock, chrono::milliseconds(1));
+            continue;
         }
-    }   
+
+        // block until stdin is readable or the next timer tick is due
+        int timeout = -1;
+        if(events && events->replaying()) { // nothing happens in real time, skip to the next event
+            EventLog::Event event;
+            if(!events->nextAny(event)) {
+                shared->stop = true;    // the recording ends here, nothing will wake us up
+                return;
+            }
+            deliver(event);
+            continue;
+        }
+        if(shared->interval != -1) {
+            time = std::chrono::duration_cast<chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            timeout = max(0LL, prevTime + timerPeriod() + 1 - time);
+        }
+        pollfd in = {STDIN_FILENO, POLLIN, 0};
+        poll(&in, 1, timeout);
+
+        pollDevices();
+    }
+}
+
+void Emulator::checkIdleLoop() {
+    // A short backward jump that arrives at the same target with the same registers and
+    // flags, without any store or device read in between, will keep doing so until an
+    // interrupt changes memory. Nothing useful can happen before that, so sleep.
+    short pswW = getPsw();
+    if(pc == loopHead && storeCount == loopStores && !ioRead && pswW == loopPsw
+        && equal(reg, reg + 7, loopReg)) {
+        waitForInterrupt();
+    }
+
+    loopHead = pc;
+    loopStores = storeCount;
+    loopPsw = pswW;
+    ioRead = false;
+    copy(reg, reg + 7, loopReg);
+}
+
+void Emulator::handleInterrupts() {
+    short deliverable = interrupts & ~maskedLines();
+    if(!deliverable) return;
+
+    int line = -1;
+    for(int i = 0; i < 8; i++) {    // highest priority wins, lower line on a tie
+        if(!((deliverable >> i) & 1)) continue;
+        if(line == -1 || irqPriority[i] < irqPriority[line]) line = i;
+    }
+
+    interrupts &= ~(1 << line);
+    enterInterrupt(line);
+}
+
+void Emulator::enterInterrupt(int line) {
+    perf[perfInterrupts]++;
+    push(pc);
+    push(getPsw());
+    //cout << "INTERRUPT JUMP FROM: " << pc << endl << flush;
+    pc = readWord(line * 2, true);
+    //cout << "INTERRUPT JUMP TO: " << pc << endl << flush;
+    psw.I = true;
+}
+
+short Emulator::maskedLines() {
+    short masked = irqMask;
+    if(psw.I) masked = 0xff;
+    if(psw.T1) masked |= 1 << timerLine;
+    if(psw.Tr) masked |= 1 << terminalLine;
+    return masked & ~(1 << errorLine);   // faults can't be masked
+}
+
+short Emulator::getPsw() {
+    materializeFlags();
+    short pswW = 0;
+    pswW |= (short)psw.I << 15;
+    pswW |= (short)psw.T1 << 14;
+    pswW |= (short)psw.Tr << 13;
+    pswW |= (short)psw.N << 3;
+    pswW |= (short)psw.C << 2;
+    pswW |= (short)psw.O << 1;
+    pswW |= (short)psw.Z << 0;
+    return pswW;
+}
+
+void Emulator::setPsw(short pswW) {
+    flagOp = flagsNone;
+    psw.I = (pswW >> 15) & 1;
+    psw.T1 = (pswW >> 14) & 1;
+    psw.Tr = (pswW >> 13) & 1;
+    psw.N = (pswW >> 3) & 1;
+    psw.C = (pswW >> 2) & 1;
+    psw.O = (pswW >> 1) & 1;
+    psw.Z = (pswW >> 0) & 1;
 }
 
 short Emulator::readWord(short address, bool isData) {
+    unsigned short addr = address;
+    if(addr >= ioStart) return readIO(addr);
+
     if(isData) {
-        char l = mem[address];
-        char h = mem[address + 1];
+        perf[perfReads]++;
+        if(cache) cache->access(addr, physical(addr));
+        if(atomicWord(addr)) return __atomic_load_n(wordAt(addr), __ATOMIC_RELAXED);
+        char l = at(addr);
+        char h = at(addr + 1);
         return (short)((h << 8) + (0xff & l));
     }
 
-    char h = mem[address];
-    char l = mem[address + 1];
+    if(cache && cache->fetches) cache->access(addr, physical(addr));
+    char h = at(addr);
+    char l = at(addr + 1);
     return (short)((h << 8) + (0xff & l));
 }
 
 void Emulator::writeWord(short word, short address, bool isData) {
     //cout << hex << (int)address << endl << flush;
-    if(address == (short)0xff00) { // Terminal out
-        cout << (char)word << flush;
-    }
-    if(address == (short)0xff10) { // Timer
-        //cout << "TIMER SET " << hex << address << " " << word << endl << flush;
-        interval = word;
-        //cout << (char)word << flush << endl;
+    unsigned short addr = address;
+    storeCount++;
+    if(addr >= ioStart) {  // device registers are not backed by memory
+        writeIO(word, addr);
+        return;
     }
+
     if(isData) {
+        perf[perfWrites]++;
+        if(cache) cache->access(addr, physical(addr));
+        if(atomicWord(addr)) {
+            __atomic_store_n(wordAt(addr), word, __ATOMIC_RELEASE);
+            return;
+        }
         char l = word & 0xff;
         char h = word >> 8;
         //cout << "WRITING: " << hex << (int)h << (int)l << endl << flush;
-        mem[address] = l;
-        mem[address + 1] = h;
+        at(addr) = l;
+        at(addr + 1) = h;
         return;
     }
 
     char h = word & 0xff;
     char l = word >> 8;
-    mem[address] = l;
-    mem[address + 1] = h;
+    at(addr) = l;
+    at(addr + 1) = h;
+}
+
+short Emulator::readIO(unsigned short address) {
+    ioRead = true;
+    short value;
+    if(devices.read && devices.read(devices.hooks, *this, address, value)) return value;
+
+    switch(address) {
+        case cpuIdReg:
+            return cpuId;
+        case cpuCountReg:
+            return cpuCount;
+        case irqMaskReg:
+            return irqMask;
+        case termIn:
+            return shared->termIn;
+        case timCfg:
+            return shared->interval;
+        case blkSectorReg:
+            return shared->blkSector;
+        case blkBufferReg:
+            return shared->blkBuffer;
+        case blkCmdReg:
+            return shared->blkStatus;
+        case blkCountReg:
+            return (short)min(shared->disk.sectors(), (size_t)0xffff);
+        case dmaSrcReg:
+            return shared->dmaSrc;
+        case dmaDstReg:
+            return shared->dmaDst;
+        case dmaLenReg:
+            return shared->dmaLen;
+    }
+    if(address >= pageTableReg && address < pageTableReg + 2 * pageCount) {
+        return pageTable[(address - pageTableReg) / 2];
+    }
+    if(address >= perfReg && address < perfReg + 4 * perfCount) { // two words per counter
+        unsigned long long value = perfLatch[(address - perfReg) / 4];
+        return (address - perfReg) & 2 ? value >> 16 : value;
+    }
+    return 0;   // unmapped, or write only
+}
+
+void Emulator::writeIO(short word, unsigned short address) {
+    if(devices.write && devices.write(devices.hooks, *this, address, word)) return;
+
+    switch(address) {
+        case termOut:
+            cout << (char)word << flush;
+            break;
+        case timCfg:
+            //cout << "TIMER SET " << hex << address << " " << word << endl << flush;
+            shared->interval = word;
+            break;
+        case irqRoute: {
+            int cpu = (word >> 8) & 0xff;
+            int line = word & 0x7;
+            if(cpu < cpuCount) shared->route[line] = cpu;
+            break;
+        }
+        case irqPriorityReg:
+            irqPriority[(word >> 8) & 0x7] = word & 0xff;
+            break;
+        case irqMaskReg:
+            irqMask = word & 0xff;
+            break;
+        case blkSectorReg:
+            shared->blkSector = word;
+            break;
+        case blkBufferReg:
+            shared->blkBuffer = word;
+            break;
+        case blkCmdReg:
+            blockCommand(word);
+            break;
+        case dmaSrcReg:
+            shared->dmaSrc = word;
+            break;
+        case dmaDstReg:
+            shared->dmaDst = word;
+            break;
+        case dmaLenReg:
+            shared->dmaLen = word;
+            break;
+        case dmaCtlReg:
+            dmaCommand(word);
+            break;
+        case perfCtlReg:
+            perfCommand(word);
+            break;
+    }
+    if(address >= pageTableReg && address < pageTableReg + 2 * pageCount) {
+        if(!mapPage((address - pageTableReg) / 2, word)) interrupts |= 1 << errorLine; // no such frame
+    }
+}
+
+void Emulator::blockCommand(short cmd) {
+    {
+        lock_guard<mutex> lock(shared->diskLock);
+        char* sector = shared->disk.sector(shared->blkSector);
+        if(!sector || (cmd != blkRead && cmd != blkWrite)) {
+            shared->blkStatus = blkError;
+        } else {
+            if(cmd == blkRead) writeMemory(shared->blkBuffer, sector, BlockDevice::sectorSize);
+            else readMemory(shared->blkBuffer, sector, BlockDevice::sectorSize);
+            shared->blkStatus = blkDone;
+        }
+    }
+    raiseInterrupt(blockLine);  // the transfer is already over, the interrupt only reports it
+}
+
+void Emulator::dmaCommand(short mode) {
+    size_t len = shared->dmaLen;
+    if(mode == dmaCopy) {   // staged through a buffer so overlapping or aliased ranges copy like memmove
+        vector<char> buffer(len);
+        readMemory(shared->dmaSrc, buffer.data(), len);
+        writeMemory(shared->dmaDst, buffer.data(), len);
+    } else if(mode == dmaFill) {
+        fillMemory(shared->dmaDst, shared->dmaSrc & 0xff, len);
+    } else {
+        interrupts |= 1 << errorLine;   // no such mode
+        return;
+    }
+    perf[perfCycles] += (len + 1) / 2 * shared->dmaCost; // the cpu is stalled while the dma owns the bus
+    raiseInterrupt(dmaLine);
+}
+
+unsigned long long Emulator::getPerfCounter(PerfCounter counter) {
+    unsigned long long value = perf[counter];
+    if(counter == perfRetired) value = retired;
+    if(counter == perfCycles) value += perf[perfReads] + perf[perfWrites];
+    return value - perfStart[counter];
+}
+
+void Emulator::perfCommand(short cmd) {
+    if(cmd == perfResetCmd) {
+        for(int i = 0; i < perfCount; i++) {
+            perfStart[i] += getPerfCounter((PerfCounter)i);
+        }
+    }
+    for(int i = 0; i < perfCount; i++) {
+        perfLatch[i] = getPerfCounter((PerfCounter)i);
+    }
+}
+
+void Emulator::semihost() {
+    unsigned short r1 = reg[1], r2 = reg[2], r3 = reg[3];
+    switch(reg[0]) {
+        case shWrite: {
+            vector<char> buffer(r2);
+            readMemory(r1, buffer.data(), buffer.size());
+            cout.write(buffer.data(), buffer.size()) << flush;
+            reg[0] = r2;
+            return;
+        }
+        case shWriteFile: {
+            ofstream out(readString(r1), ios::binary | ios::trunc);
+            if(out.fail()) {
+                reg[0] = -1;
+                return;
+            }
+            vector<char> buffer(r3);
+            readMemory(r2, buffer.data(), buffer.size());
+            out.write(buffer.data(), buffer.size());
+            reg[0] = out.fail() ? -1 : r3;
+            return;
+        }
+        case shReadFile: {
+            ifstream in(readString(r1), ios::binary);
+            if(in.fail()) {
+                reg[0] = -1;
+                return;
+            }
+            vector<char> buffer(r3);
+            in.read(buffer.data(), buffer.size());
+            writeMemory(r2, buffer.data(), in.gcount());
+            reg[0] = in.gcount();
+            return;
+        }
+        case shTime: {
+            long long ms = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+            long long seconds = ms / 1000;
+            reg[0] = seconds & 0xffff;
+            reg[1] = (seconds >> 16) & 0xffff;
+            reg[2] = ms % 1000;
+            return;
+        }
+        case shExit:
+            shared->exitStatus = (short)r1;
+            shared->stop = true;
+            running = false;
+            return;
+        default:
+            interrupts |= 1 << errorLine;   // no such operation
+            return;
+    }
+}
+
+string Emulator::readString(unsigned short address) {
+    string str;
+    for(int i = 0; i < 256; i++) {  // paths longer than that are cut
+        char c = at(address + i);
+        if(!c) break;
+        str += c;
+    }
+    return str;
+}
+
+void Emulator::fillMemory(unsigned short address, char value, size_t len) {
+    while(len > 0) {
+        size_t chunk = min(len, pageSize - (address & (pageSize - 1)));
+        memset(&at(address), value, chunk);
+        address += chunk;
+        len -= chunk;
+    }
 }
 
 struct termios oldStdin;
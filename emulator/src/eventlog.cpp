@@ -0,0 +1,60 @@
+#include "../inc/eventlog.h"
+#include <iostream>
+#include <sstream>
+
+bool EventLog::record(const string& file) {
+    out.open(file, ofstream::out | ofstream::trunc);
+    if(!out.is_open()) {
+        cout << "Couldn't open event log!" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool EventLog::replay(const string& file) {
+    ifstream in(file);
+    if(in.fail()) {
+        cout << file << " could not be opened!" << endl;
+        return false;
+    }
+
+    // one event per line: RETIRED TYPE [VALUE]
+    string line;
+    while(getline(in, line)) {
+        stringstream ss(line);
+        Event event = {0, 0, 0};
+        int value = 0;
+        ss >> event.retired >> event.type;
+        if(ss.fail() || (event.type != timerTick && event.type != input)) {
+            cout << "Invalid event: " << line << endl;
+            return false;
+        }
+        if(event.type == input) {
+            ss >> value;
+            event.value = value;
+        }
+        pending.push_back(event);
+    }
+    replayMode = true;
+    return true;
+}
+
+void EventLog::log(unsigned long long retired, char type, char value) {
+    out << retired << " " << type;
+    if(type == input) out << " " << (int)value;
+    out << "\n";
+}
+
+bool EventLog::next(unsigned long long retired, Event& event) {
+    if(pending.empty() || pending.front().retired > retired) return false;
+    event = pending.front();
+    pending.pop_front();
+    return true;
+}
+
+bool EventLog::nextAny(Event& event) {
+    if(pending.empty()) return false;
+    event = pending.front();
+    pending.pop_front();
+    return true;
+}
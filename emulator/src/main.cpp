@@ -1,21 +1,161 @@
 #include <iostream>
 #include <string>
+#include <sstream>
 
 #include "../inc/emulator.h"
+#include "../inc/coverage.h"
+#include "../inc/cache.h"
 
 using namespace std;
 
 int main(int argc, const char *argv[])
 {
-    if(argc < 2) {
+    string memFile;
+    int cpuCount = 1;
+    bool idleDetect = false;
+    size_t memSize = 1 << 16;
+    string coverageFile;
+    string symbolsFile;
+    string diskFile;
+    string cacheFile;
+    size_t cacheSize = 4096;
+    int cacheWays = 4;
+    int cacheLine = 16;
+    bool cacheFetches = false;
+    string recordFile;
+    string replayFile;
+    int dmaCost = 1;
+    bool semihosting = false;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg.rfind("-smp=", 0) == 0) {    // number of virtual cpus
+            cpuCount = stoi(arg.substr(5));
+            if(cpuCount < 1 || cpuCount > 256) {
+                cout << "Invalid cpu count!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg.rfind("-coverage=", 0) == 0) { // write guest code coverage
+            coverageFile = arg.substr(10);
+            continue;
+        }
+        if(arg.rfind("-cache=", 0) == 0) {    // simulate a cache and write its report
+            cacheFile = arg.substr(7);
+            continue;
+        }
+        if(arg.rfind("-cacheconfig=", 0) == 0) {  // size,ways,line in bytes, e.g. 4096,4,16
+            char comma;
+            stringstream ss(arg.substr(13));
+            ss >> cacheSize >> comma >> cacheWays >> comma >> cacheLine;
+            if(ss.fail()) {
+                cout << "Invalid cache config!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg == "-cachefetch") {  // instruction fetches go through the cache too
+            cacheFetches = true;
+            continue;
+        }
+        if(arg.rfind("-record=", 0) == 0) {   // log terminal and timer events
+            recordFile = arg.substr(8);
+            continue;
+        }
+        if(arg.rfind("-replay=", 0) == 0) {   // take terminal and timer events from a log
+            replayFile = arg.substr(8);
+            continue;
+        }
+        if(arg.rfind("-symbols=", 0) == 0) {  // linker listing used to name coverage addresses
+            symbolsFile = arg.substr(9);
+            continue;
+        }
+        if(arg.rfind("-mem=", 0) == 0) {   // physical memory behind the mmu, e.g. -mem=4M
+            size_t suffix;
+            memSize = stoul(arg.substr(5), &suffix);
+            string unit = arg.substr(5 + suffix);
+            if(unit == "K") memSize <<= 10;
+            if(unit == "M") memSize <<= 20;
+            if(memSize < 1 << 16 || memSize > (size_t)1 << 28) {
+                cout << "Memory size must be between 64K and 256M!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg.rfind("-disk=", 0) == 0) {   // host file behind the block device
+            diskFile = arg.substr(6);
+            continue;
+        }
+        if(arg.rfind("-dmacost=", 0) == 0) {    // cycles charged per word moved by the dma
+            dmaCost = stoi(arg.substr(9));
+            if(dmaCost < 0) {
+                cout << "Invalid dma cost!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg == "-semihost") {    // int on line 7 calls into the host
+            semihosting = true;
+            continue;
+        }
+        if(arg == "-idle") {    // sleep through busy wait loops
+            idleDetect = true;
+            continue;
+        }
+        memFile = arg;
+    }
+
+    if(memFile.empty()) {
         cout << "Memory context needed!!" << endl;
         return -1;
     }
-
-    string memFile = argv[1];
     
-    Emulator emu(memFile);
+    if(idleDetect && cpuCount > 1) {   // a spin on a word another cpu writes would look idle
+        cout << "Idle loop detection needs a single cpu!" << endl;
+        return -1;
+    }
+
+    Emulator emu(memFile, cpuCount, idleDetect, memSize);
+    if(!diskFile.empty() && !emu.attachDisk(diskFile)) return -1;
+    emu.setDmaCost(dmaCost);
+    emu.setSemihosting(semihosting);
+    unique_ptr<Coverage> coverage;
+    if(!coverageFile.empty()) {
+        coverage.reset(new Coverage());
+        if(!symbolsFile.empty() && !coverage->loadSymbols(symbolsFile)) return -1;
+        emu.setCoverage(coverage.get());
+    }
+    unique_ptr<Cache> cache;
+    if(!cacheFile.empty()) {
+        if(cpuCount > 1) {
+            cout << "Cache simulation needs a single cpu!" << endl;
+            return -1;
+        }
+        cache.reset(new Cache());
+        if(!cache->configure(cacheSize, cacheWays, cacheLine)) return -1;
+        if(!symbolsFile.empty() && !cache->loadSymbols(symbolsFile)) return -1;
+        cache->fetches = cacheFetches;
+        emu.setCache(cache.get());
+    }
+    EventLog events;
+    if(!recordFile.empty() || !replayFile.empty()) {
+        if(cpuCount > 1) {
+            cout << "Record and replay need a single cpu!" << endl;
+            return -1;
+        }
+        if(!recordFile.empty() && !replayFile.empty()) {
+            cout << "Can't record and replay at the same time!" << endl;
+            return -1;
+        }
+        if(!recordFile.empty() && !events.record(recordFile)) return -1;
+        if(!replayFile.empty() && !events.replay(replayFile)) return -1;
+        emu.setEventLog(&events);
+    }
     emu.startEmulation();
 
-    return 0;
+    if(coverage) coverage->write(coverageFile);
+    if(cache) cache->write(cacheFile);
+
+    return emu.getExitStatus();
 }
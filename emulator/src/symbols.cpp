@@ -0,0 +1,70 @@
+#include "../inc/symbols.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+bool Symbols::load(const string& listing) {
+    ifstream in(listing);
+    if(in.fail()) {
+        cout << listing << " could not be opened!" << endl;
+        return false;
+    }
+
+    string line;
+    while(getline(in, line) && line != "SECTION TABLE");
+    getline(in, line); // header
+
+    // section table: NAME SIZE ADDRESS [LOAD]
+    while(getline(in, line) && !line.empty()) {
+        stringstream ss(line);
+        string name;
+        size_t size;
+        int address;
+        ss >> name >> hex >> size >> address;
+        if(ss.fail() || name == "ABSOLUTE" || name == "UNDEFINED" || size == 0) continue;
+        sections[address] = make_pair(name, size);
+    }
+
+    while(getline(in, line) && line != "SYMBOL TABLE");
+    getline(in, line); // header
+
+    // symbol table: NAME SECTION VALUE TYPE
+    while(getline(in, line) && !line.empty()) {
+        stringstream ss(line);
+        string name, section;
+        int value;
+        ss >> name >> section >> hex >> value;
+        if(ss.fail() || section == "ABSOLUTE" || section == "UNDEFINED") continue;
+
+        // labels win over the section symbol at the same address
+        auto it = symbols.find(value);
+        if(it == symbols.end() || name != section) {
+            symbols[value] = name;
+        }
+    }
+    return true;
+}
+
+string Symbols::symbolAt(unsigned short address) {
+    auto it = symbols.upper_bound(address);
+    if(it == symbols.begin()) return "?";
+    return (--it)->second;
+}
+
+string Symbols::symbolize(unsigned short address) {
+    auto it = symbols.upper_bound(address);
+    if(it == symbols.begin()) return "?";
+    it--;
+
+    stringstream ss;
+    ss << it->second << "+0x" << hex << address - it->first;
+    return ss.str();
+}
+
+string Symbols::sectionAt(unsigned short address) {
+    auto it = sections.upper_bound(address);
+    if(it == sections.begin()) return "?";
+    it--;
+    if(address >= it->first + it->second.second) return "?";
+    return it->second.first;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Persistent mode driver for the fuzz targets when they are not linked with libFuzzer.
+// Every input runs in this one process, the targets reset their state in place.
+//   fuzz_x [-runs=N] file...   run every file N times and report executions per second
+//   fuzz_x                     read inputs from stdin (AFL persistent mode with afl-clang-fast)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+
+#ifndef __AFL_LOOP
+#define __AFL_LOOP(n) (first ? (first = false, true) : false)
+#endif
+
+int main(int argc, char* argv[])
+{
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    int runs = 1;
+    vector<string> inputs;
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg.rfind("-runs=", 0) == 0) {
+            runs = stoi(arg.substr(6));
+            continue;
+        }
+        inputs.push_back(arg);
+    }
+
+    if(inputs.empty()) {
+        bool first = true;
+        vector<uint8_t> buf(1 << 20);
+        while(__AFL_LOOP(10000)) {
+            cin.clear();
+            cin.read((char*)buf.data(), buf.size());
+            LLVMFuzzerTestOneInput(buf.data(), cin.gcount());
+        }
+        return 0;
+    }
+
+    vector<vector<uint8_t>> data;
+    for(auto& file : inputs) {
+        ifstream in(file, ios::binary);
+        if(in.fail()) {
+            cerr << file << " could not be opened!" << endl;
+            return -1;
+        }
+        stringstream ss;
+        ss << in.rdbuf();
+        string s = ss.str();
+        data.emplace_back(s.begin(), s.end());
+    }
+
+    auto start = chrono::steady_clock::now();
+    long long execs = 0;
+    for(int r = 0; r < runs; r++) {
+        for(auto& d : data) {
+            LLVMFuzzerTestOneInput(d.data(), d.size());
+            execs++;
+        }
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << execs << " executions in " << secs << "s, " << (long long)(execs / (secs > 0 ? secs : 1)) << " exec/s" << endl;
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#include <sstream>
+#include <cstdint>
+#include "../../assembler/inc/assembler.h"
+
+// Assembles the input as source text, object output goes to a reused buffer.
+
+static Assembler* assembler;
+static stringstream object;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    cout.rdbuf(nullptr);    // diagnostics are not interesting here
+    assembler = new Assembler();
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    istringstream in(string((const char*)data, size));
+    if(assembler->assembleSource(in)) {
+        object.str("");
+        assembler->writeObject(object);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include "../../emulator/inc/emulator.h"
+
+// Runs the input on the emulator for a bounded number of instructions.
+//   FUZZ_BUDGET       instructions per input (default 100000)
+//   FUZZ_IMAGE        base image, without it the input is the image
+//   FUZZ_INPUT_ADDR   where the input is copied into FUZZ_IMAGE (hex)
+// Every input starts from a snapshot taken once the base image is loaded.
+
+static Emulator* emu;
+static Emulator::Snapshot start;
+static unsigned long long budget = 100000;
+static long inputAddr = -1;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    cout.rdbuf(nullptr);    // guest terminal output
+    emu = new Emulator();
+
+    if(getenv("FUZZ_BUDGET")) budget = strtoull(getenv("FUZZ_BUDGET"), nullptr, 10);
+    if(getenv("FUZZ_IMAGE")) {
+        if(!emu->loadImage(string(getenv("FUZZ_IMAGE")))) {
+            cerr << "FUZZ_IMAGE could not be loaded!" << endl;
+            exit(-1);
+        }
+        inputAddr = getenv("FUZZ_INPUT_ADDR") ? strtol(getenv("FUZZ_INPUT_ADDR"), nullptr, 16) : 0;
+    } else {
+        emu->loadImage("", 0);
+    }
+    emu->reset();
+    emu->saveSnapshot(start);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    emu->restoreSnapshot(start);
+    if(inputAddr < 0) {
+        emu->writeMemory(0, (const char*)data, min(size, (size_t)1 << 16));
+        emu->reset();
+    } else {
+        emu->writeMemory(inputAddr, (const char*)data, min(size, (size_t)(1 << 16) - inputAddr));
+    }
+    emu->runUntil(-1, budget);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include <iostream>
+#include <sstream>
+#include <cstdint>
+#include "../../linker/inc/linker.h"
+
+// Links the input as a single object file into a hex image, no files are written.
+
+static Linker* linker;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    cout.rdbuf(nullptr);    // diagnostics are not interesting here
+    linker = new Linker("", {}, true, false, {});
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    linker->reset();
+    istringstream in(string((const char*)data, size));
+    if(!linker->loadObject(in, "fuzz")) return 0;
+    linker->build();
+    return 0;
+}
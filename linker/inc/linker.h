@@ -3,6 +3,9 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <istream>
+#include <ostream>
+#include "../../common/inc/stats.h"
 
 using namespace std;
 
@@ -11,40 +14,46 @@ private:
     struct SymbolEntry {
         string name;
         string section;
-        int value;
-        bool isDefined;
-        bool isGlobal;
-        bool isExtern;
+        int value = 0;
+        bool isDefined = false;
+        bool isGlobal = false;
+        bool isExtern = false;
     };
 
     struct SectionEntry {
         string name;
-        size_t size;
+        size_t size = 0;
         vector<char> data;
         vector<size_t> offsets;
-        size_t address = 0;
+        size_t address = 0;     // where the section runs
+        size_t loadAddress = 0; // where it is stored in the image, differs for banked sections
         bool placed = false;
+        bool nobits = false;    // zero filled, has a size but no data
     };
 
     struct RelocationEntry {
         string section;
-        int offset;
+        int offset = 0;
         string type;
         string symbolName;
-        bool isData;
-        size_t size;
+        bool isData = false;
+        size_t size = 0;
         string file;
     };
 
     struct SectionInfo {
-        size_t size;
-        size_t offset;
+        size_t size = 0;
+        size_t offset = 0;
     };
 
     string outputFile;
     map<string, int> placement;
+    map<string, int> banks; // section -> physical load address
     bool hexOut;
     bool linkableOut;
+    bool segmentedOut;
+    bool listing = true;    // write the text listing to outputFile
+    Stats* stats = nullptr; // phase timings and counts, for -stats
     vector<string> inputFiles;
     map<string, map<string, SymbolEntry>> symbolTables; //[file][symbol]
     map<string, map<string, SectionEntry>> sectionTables; //[file][section]
@@ -55,13 +64,21 @@ private:
     vector<RelocationEntry> relocationTable;
     map<string, map<string, SectionInfo>> sectionInfoTable;//[file][section]
 
-    void createTxt(ofstream& out);
-    void createBin(ofstream& out);
+    void createTxt(ostream& out);
+    void createBin(ostream& out);
+    void createSegmentedBin(ostream& out);
 public:
-    Linker(string outputFile, map<string, int> placement, bool hexOut, bool linkableOut, vector<string> inputFiles) 
-        : outputFile(outputFile), placement(placement), hexOut(hexOut), linkableOut(linkableOut), inputFiles(inputFiles) {}
+    Linker(string outputFile, map<string, int> placement, bool hexOut, bool linkableOut, vector<string> inputFiles, bool segmentedOut = false, map<string, int> banks = {}) 
+        : outputFile(outputFile), placement(placement), banks(banks), hexOut(hexOut), linkableOut(linkableOut), segmentedOut(segmentedOut), inputFiles(inputFiles) {}
     void link();
     bool loadData();
+    bool loadObject(istream& in, const string& name);
+    void reset();
+    void setListing(bool listing) { this->listing = listing; }
+    void setStats(Stats* stats) { this->stats = stats; }
+    bool build();   // everything between loading the objects and writing the outputs
+    void writeImage(ostream& out);      // flat or segmented, as configured
+    void writeListing(ostream& out);
     bool createSections();
     bool createSymbolTable();
     bool createRelocationTable();
@@ -2,22 +2,27 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <algorithm>
+#include "../../common/inc/listing.h"
 
 void Linker::link() {
-    if(!loadData()) return;
-    if(!createSections()) return;
-    if(!createSymbolTable()) return;
-    if(!createRelocationTable()) return;
-    if(!relocate()) return;
+    {
+        Stats::Phase phase(stats, "loadData");
+        if(!loadData()) return;
+    }
+    if(!build()) return;
 
+    Stats::Phase phase(stats, "output");
     ofstream outputStream;
-    outputStream.open(outputFile, ofstream::out | ofstream::trunc);
-    if(!outputStream.is_open()) {
-        cout << "Couldn't open output file!" << endl;
-        return;
+    if(listing) {
+        outputStream.open(outputFile, ofstream::out | ofstream::trunc);
+        if(!outputStream.is_open()) {
+            cout << "Couldn't open output file!" << endl;
+            return;
+        }
+        createTxt(outputStream);
+        outputStream.close();
     }
-    createTxt(outputStream);
-    outputStream.close();
 
     if(hexOut) {
         outputStream.open("bin_" + outputFile, ofstream::out | ofstream::binary | ofstream::trunc);
@@ -25,11 +30,53 @@ void Linker::link() {
             cout << "Couldn't open output binary file!" << endl;
             return;
         }
-        createBin(outputStream);
+        writeImage(outputStream);
         //outputStram.close();
     }
 }
 
+bool Linker::build() {
+    {
+        Stats::Phase phase(stats, "createSections");
+        if(!createSections()) return false;
+    }
+    {
+        Stats::Phase phase(stats, "createSymbolTable");
+        if(!createSymbolTable()) return false;
+    }
+    {
+        Stats::Phase phase(stats, "createRelocationTable");
+        if(!createRelocationTable()) return false;
+    }
+    {
+        Stats::Phase phase(stats, "relocate");
+        if(!relocate()) return false;
+    }
+
+    if(stats) {
+        size_t bytes = 0;
+        for(auto& s : sectionTable) bytes += s.second.size;
+        stats->count("files", inputFiles.size());
+        stats->count("symbols", symbolTable.size());
+        stats->count("sections", sectionTable.size());
+        stats->count("relocations", relocationTable.size());
+        stats->count("bytes", bytes);
+    }
+    return true;
+}
+
+void Linker::writeImage(ostream& out) {
+    if(segmentedOut) {
+        createSegmentedBin(out);
+    } else {
+        createBin(out);
+    }
+}
+
+void Linker::writeListing(ostream& out) {
+    createTxt(out);
+}
+
 bool Linker::relocate() {
 
     for(auto& re : relocationTable) {
@@ -67,14 +114,14 @@ bool Linker::relocate() {
             }
 
             if(re.isData) {
-                int val = (int)(sectionTable[re.section].data[re.offset] & 0xff + ((sectionTable[re.section].data[re.offset + 1] & 0xff) << 8))
+                int val = (int)((sectionTable[re.section].data[re.offset] & 0xff) + ((sectionTable[re.section].data[re.offset + 1] & 0xff) << 8))
                         + (int)symbolTable[re.symbolName].value
                         //+ (int)(symbolTable[re.symbolName].name == symbolTable[re.symbolName].section ? sectionInfoTable[re.file][re.section].offset : symbolTable[re.symbolName].value)
                         - pcRelOffset;
                 sectionTable[re.section].data[re.offset] = val & 0xff;
                 sectionTable[re.section].data[re.offset + 1] = (val >> 8) & 0xff;
             } else {
-                int val = (int)(sectionTable[re.section].data[re.offset] & 0xff + ((sectionTable[re.section].data[re.offset - 1] & 0xff) << 8))
+                int val = (int)((sectionTable[re.section].data[re.offset] & 0xff) + ((sectionTable[re.section].data[re.offset - 1] & 0xff) << 8))
                         + (int)symbolTable[re.symbolName].value
                         //+ (int)(symbolTable[re.symbolName].name == symbolTable[re.symbolName].section ? sectionInfoTable[re.file][re.section].offset : symbolTable[re.symbolName].value)
                         - pcRelOffset;
@@ -94,24 +141,29 @@ bool Linker::createSections() {
         for(auto& se : st.second) {
             SectionInfo si;
             si.size = se.second.size;
+            bool first = !sectionTable.count(se.second.name);
             si.offset = sectionTable[se.second.name].size;
             sectionTable[se.second.name].size += si.size;
             sectionTable[se.second.name].name = se.second.name;
+            // stays nobits only if every file has it nobits
+            sectionTable[se.second.name].nobits = se.second.nobits && (first || sectionTable[se.second.name].nobits);
             sectionInfoTable[st.first][se.second.name] = si;
         }
     }
 
     for(auto& stIt : sectionTables) { // copy data
         for(auto& seIt : stIt.second) {
-            SectionEntry se = seIt.second;
+            const SectionEntry& se = seIt.second;
             SectionInfo si = sectionInfoTable[stIt.first][se.name];
             //cout<< "SECTION " << seIt.first << " FILE " << stIt.first << endl;
             for(auto& off : se.offsets) {
                 sectionTable[se.name].offsets.push_back(off + si.offset + sectionTable[se.name].address);
             }
-            for(auto& dat : se.data) {
-                sectionTable[se.name].data.push_back(dat);
+            if(se.nobits && !sectionTable[se.name].nobits) {  // merged with data from another file
+                sectionTable[se.name].data.resize(sectionTable[se.name].data.size() + se.size, 0);
+                continue;
             }
+            sectionTable[se.name].data.insert(sectionTable[se.name].data.end(), se.data.begin(), se.data.end());
         }
     }
 
@@ -119,17 +171,21 @@ bool Linker::createSections() {
         int pos = 0;
         for(auto& p : placement) {  // first honor -place
             sectionTable[p.first].address = p.second;
+            sectionTable[p.first].placed = true;
+            if(banks.count(p.first)) continue; // banked sections may share a window
             if(pos > sectionTable[p.first].address) { // not ideal, but it's almost midnight...
                 cout << "Invalid positions!! Sections overlap!!" << endl;
                 return false;
             }
             pos = sectionTable[p.first].address + sectionTable[p.first].size;
-            sectionTable[p.first].placed = true;
         }
         for(auto& se : sectionTable) { // place the rest sequentally
             if(se.second.name == "ABSOLUTE" || se.second.name == "UNDEFINED" | se.second.placed) continue;
             se.second.address = pos;
-            pos += se.second.data.size();
+            pos += se.second.nobits ? se.second.size : se.second.data.size();
+        }
+        for(auto& se : sectionTable) { // sections are loaded where they run unless -bank says otherwise
+            se.second.loadAddress = banks.count(se.first) ? banks[se.first] : se.second.address;
         }
     }
 
@@ -191,6 +247,11 @@ bool Linker::createRelocationTable() {
     for(auto& rtIt : relocationTables) {
         auto& rt = rtIt.second;
         for(auto& rel : rt) {
+            auto target = sectionTable.find(rel.section);
+            if(target != sectionTable.end() && target->second.nobits) {
+                cout << rtIt.first << ": relocation in nobits section " << rel.section << "!" << endl;
+                return false;
+            }
             RelocationEntry re;
             re.section = rel.section;
             re.offset = rel.offset + sectionInfoTable[rtIt.first][re.section].offset; // - address
@@ -212,210 +273,219 @@ bool Linker::loadData() {
             cout << file << " could not be opened!" << endl;
             return false;
         }
-
-        map<string, SymbolEntry> symbolTable;
-        map<string, SectionEntry> sectionTable;
-        vector<RelocationEntry> relocationTable;
-
-
-        //read sym table size
-        size_t symTSize = 0;
-        in.read((char*)&symTSize, sizeof(symTSize));
-        //cout << symTSize << endl;
-        //read sym table
-        for(size_t i = 0; i < symTSize; i++) {
-            SymbolEntry se;
-            size_t len;
-            // name
-            in.read((char*)&len, sizeof(len));
-            se.name.resize(len);
-            in.read((char*)se.name.c_str(), len);
-
-            // section
-            in.read((char*)&len, sizeof(len));
-            se.section.resize(len);
-            in.read((char*)se.section.c_str(), len);
-
-            // value
-            in.read((char*)&se.value, sizeof(se.value));
-            //defined
-            in.read((char*)&se.isDefined, sizeof(se.isDefined));
-            //global
-            in.read((char*)&se.isGlobal, sizeof(se.isGlobal));
-            //extern
-            in.read((char*)&se.isExtern, sizeof(se.isExtern));
-            
-            symbolTable[se.name] = se;
+        if(!loadObject(in, file)) {
+            cout << file << " is not a valid object file!" << endl;
+            return false;
         }
+        in.close();
+    }
 
-        //read sec table size
-        size_t secTSize = 0;
-        in.read((char*)&secTSize, sizeof(secTSize));
-        //read sec table
-        for(size_t i = 0; i < secTSize; i++) {
-            SectionEntry se;
-            size_t len;
-            // name
-            in.read((char*)&len, sizeof(len));
-            se.name.resize(len);
-            in.read((char*)se.name.c_str(), len);
+    return true;
+}
 
-            
+// reads a length prefixed string, refusing lengths larger than the rest of the stream
+static bool readString(istream& in, string& s, size_t remaining) {
+    size_t len;
+    if(!in.read((char*)&len, sizeof(len)) || len > remaining) return false;
+    s.resize(len);
+    return (bool)in.read(&s[0], len);
+}
 
-            in.read((char*)&se.size, sizeof(se.size));
-            for(int i = 0; i < se.size; i++) {
-                char c;
-                in.read(&c, sizeof(c));
-                //cout << c << endl;
-                se.data.push_back(c);
-            }
-            
-            size_t offSize;
-            in.read((char*)&offSize, sizeof(offSize));
-            for(int i = 0; i < offSize; i++) {
-                size_t off;
-                in.read((char*)&off, sizeof(off));
-                //cout << c << endl;
-                se.offsets.push_back(off);
-            }
+bool Linker::loadObject(istream& in, const string& name) {
+    in.seekg(0, ios::end);
+    size_t remaining = in.tellg();
+    in.seekg(0);
+
+    map<string, SymbolEntry> symbolTable;
+    map<string, SectionEntry> sectionTable;
+    vector<RelocationEntry> relocationTable;
+
+
+    //read sym table size
+    size_t symTSize = 0;
+    if(!in.read((char*)&symTSize, sizeof(symTSize)) || symTSize > remaining) return false;
+    //cout << symTSize << endl;
+    //read sym table
+    for(size_t i = 0; i < symTSize; i++) {
+        SymbolEntry se;
+        // name
+        if(!readString(in, se.name, remaining)) return false;
+        // section
+        if(!readString(in, se.section, remaining)) return false;
+
+        // value
+        in.read((char*)&se.value, sizeof(se.value));
+        //defined
+        in.read((char*)&se.isDefined, sizeof(se.isDefined));
+        //global
+        in.read((char*)&se.isGlobal, sizeof(se.isGlobal));
+        //extern
+        in.read((char*)&se.isExtern, sizeof(se.isExtern));
+        if(!in) return false;
+        
+        symbolTable[se.name] = se;
+    }
 
-            sectionTable[se.name] = se;
+    //read sec table size
+    size_t secTSize = 0;
+    if(!in.read((char*)&secTSize, sizeof(secTSize)) || secTSize > remaining) return false;
+    //read sec table
+    for(size_t i = 0; i < secTSize; i++) {
+        SectionEntry se;
+        // name
+        if(!readString(in, se.name, remaining)) return false;
+
+        if(!in.read((char*)&se.size, sizeof(se.size))) return false;
+        if(!in.read((char*)&se.nobits, sizeof(se.nobits))) return false;
+        if(!se.nobits) {
+            if(se.size > remaining) return false;
+            se.data.resize(se.size);
+            if(!in.read(se.data.data(), se.size)) return false;
         }
+        
+        size_t offSize;
+        if(!in.read((char*)&offSize, sizeof(offSize)) || offSize > remaining) return false;
+        se.offsets.resize(offSize);
+        if(!in.read((char*)se.offsets.data(), offSize * sizeof(size_t))) return false;
+        size_t end = se.nobits ? se.size : se.data.size();
+        for(auto off : se.offsets) if(off > end) return false;
+
+        sectionTable[se.name] = se;
+    }
 
-        //read rel table size
-        size_t relTSize = 0;
-        in.read((char*)&relTSize, sizeof(relTSize));
-        //read rel table
-        for(size_t i = 0; i < relTSize; i++) {
-            RelocationEntry re;
-            size_t len;
-            in.read((char*)&len, sizeof(len));
-            re.section.resize(len);
-            in.read((char*)re.section.c_str(), len);
+    //read rel table size
+    size_t relTSize = 0;
+    if(!in.read((char*)&relTSize, sizeof(relTSize)) || relTSize > remaining) return false;
+    //read rel table
+    for(size_t i = 0; i < relTSize; i++) {
+        RelocationEntry re;
+        if(!readString(in, re.section, remaining)) return false;
 
-            in.read((char*)&re.size, sizeof(re.size));
-            in.read((char*)&re.offset, sizeof(re.offset));
+        in.read((char*)&re.size, sizeof(re.size));
+        in.read((char*)&re.offset, sizeof(re.offset));
 
-            in.read((char*)&len, sizeof(len));
-            re.type.resize(len);
-            in.read((char*)re.type.c_str(), len);
+        if(!readString(in, re.type, remaining)) return false;
+        if(!readString(in, re.symbolName, remaining)) return false;
 
-            in.read((char*)&len, sizeof(len));
-            re.symbolName.resize(len);
-            in.read((char*)re.symbolName.c_str(), len);
+        in.read((char*)&re.isData, sizeof(re.isData));
+        if(!in) return false;
 
-            in.read((char*)&re.isData, sizeof(re.isData));
+        // the patched bytes must lie in a section of this file
+        auto target = sectionTable.find(re.section);
+        if(target == sectionTable.end()) return false;
+        long end = target->second.nobits ? target->second.size : target->second.data.size();
+        long first = re.isData ? re.offset : (long)re.offset - 1;
+        if(first < 0 || first + 1 >= end) return false;
 
-            relocationTable.push_back(re);
-        }
-        in.close();
-        sectionTables[file] = sectionTable;
-        symbolTables[file] = symbolTable;
-        relocationTables[file] = relocationTable;
+        relocationTable.push_back(re);
     }
+    sectionTables[name] = sectionTable;
+    symbolTables[name] = symbolTable;
+    relocationTables[name] = relocationTable;
 
     return true;
 }
 
-void Linker::createTxt(ofstream& out) {
-    out << hex << endl << "SECTION TABLE" << endl
-        << left << setw(14) << "NAME"
-        << left << setw(10) << "SIZE"
-        << left << setw(10) << "ADDRESS"
-        << endl;
+void Linker::reset() {
+    symbolTables.clear();
+    sectionTables.clear();
+    relocationTables.clear();
+    symbolTable.clear();
+    sectionTable.clear();
+    relocationTable.clear();
+    sectionInfoTable.clear();
+}
+
+void Linker::createTxt(ostream& out) {
+    Listing txt;
+    txt << "\nSECTION TABLE\n";
+    txt.left("NAME", 14).left("SIZE", 10).left("ADDRESS", 10).left("LOAD", 10) << '\n';
     for(auto& se : sectionTable) {
-        out << left << setw(14) << se.second.name
-             << left << setw(10) << se.second.size
-             << left << setw(10) << se.second.address
-             << endl;
+        txt.left(se.second.name, 14).leftHex(se.second.size, 10).leftHex(se.second.address, 10).leftHex(se.second.loadAddress, 10) << '\n';
     }
 
-    out << endl << "SYMBOL TABLE" << endl
-        << left << setw(14) << "NAME"
-        << left << setw(10) << "SECTION"
-        << left << setw(10) << "VALUE"
-        << left << setw(10) << "TYPE"
-        << endl;
-    map<string, SymbolEntry>::iterator it;
-    for (it = symbolTable.begin(); it != symbolTable.end(); it++)
-    {
-        SymbolEntry& se = it->second;
+    txt << "\nSYMBOL TABLE\n";
+    txt.left("NAME", 14).left("SECTION", 10).left("VALUE", 10).left("TYPE", 10) << '\n';
+    for(auto& it : symbolTable) {
+        SymbolEntry& se = it.second;
         if(se.name == "") continue;
-        out << left << setw(14) << se.name 
-            << left << setw(10) << se.section
-            << right << setw(4) << setfill('0') << hex << se.value << "      "
-            << left << (se.isGlobal ? "G" : (se.isExtern ? "E" : "L"))
-            << endl << setfill(' ');
+        txt.left(se.name, 14).left(se.section, 10).hex((unsigned)se.value, 4) << "      "
+            << (se.isGlobal ? 'G' : (se.isExtern ? 'E' : 'L')) << '\n';
     }
 
+    map<string, vector<const RelocationEntry*>> relocations;    // by section, in table order
+    for(auto& re : relocationTable) relocations[re.section].push_back(&re);
 
-    map<string, SectionEntry>::iterator secIt;
-    int pos = 0;
-    for (secIt = sectionTable.begin(); secIt != sectionTable.end(); secIt++)
-    {
-        SectionEntry& se = secIt->second;
-        out << endl << endl << "SECTION " << se.name << " " << secIt->first << endl;
-        
-        out << "RELOCATION:" << endl;
-        out << left << setfill(' ') << setw(12) << "SYMBOL" << setw(10) << "OFFSET" << setw(12) << "R_TYPE" << setw(14) << "DAT/INSTR" << endl;
-        for(auto& re : relocationTable) {
-            if(re.section != se.name) continue;
-            out << hex << left << setw(12) << re.symbolName << setw(10) << re.offset << setw(12) << re.type << setw(14) << (re.isData ? "DAT" : "INS") << endl;
+    for(auto& it : sectionTable) {
+        SectionEntry& se = it.second;
+        txt << "\n\nSECTION " << se.name << " " << it.first << "\nRELOCATION:\n";
+        txt.left("SYMBOL", 12).left("OFFSET", 10).left("R_TYPE", 12).left("DAT/INSTR", 14) << '\n';
+        for(auto re : relocations[se.name]) {
+            txt.left(re->symbolName, 12).leftHex((unsigned)re->offset, 10).left(re->type, 12).left(re->isData ? "DAT" : "INS", 14) << '\n';
         }
 
-        out << "DATA:" << endl;
-        if(linkableOut) {
+        txt << "DATA:" << (se.nobits ? " NOBITS" : "") << '\n';
+        if(linkableOut) {   // same as the assembler's, one line per offset
             if(se.offsets.size() == 0) continue; // skip printout if empty
-            for(int i = 0; i < se.offsets.size() - 1; i++) {
-                int currOff = se.offsets[i];
-                int nextOff = se.offsets[i+1];
-                out << hex << right << setw(4) << setfill('0') << (0xffff & currOff) << ": ";
-                for (int j = currOff; j < nextOff; j++)
-                {
-                    char c = se.data[j];
-                    out << hex << setw(2) << (0xff & c) << " ";
-                }
-                out << endl;
+            for(size_t i = 0; i < se.offsets.size(); i++) {
+                size_t end = i + 1 < se.offsets.size() ? se.offsets[i + 1] : se.data.size();
+                if(i) txt << '\n';
+                txt.hex(0xffff & se.offsets[i], 4) << ": ";
+                for(size_t j = se.offsets[i]; j < end; j++) txt.byte(se.data[j]);
             }
-            //last one
-            out << right << hex << setw(4) << (0xffff & se.offsets[se.offsets.size() - 1]) << ": ";
-            for (int j = se.offsets[(int)se.offsets.size() - 1]; j < se.data.size(); j++)
-            {
-                char c = se.data[j];
-                out << hex << setw(2) << (0xff & c) << " ";
-            }
-        } else {
-            int cnt = 0;
-            out << hex;
-            pos = se.address;
-            for(auto& dat : se.data) {
-                if(cnt++ % 8 == 0) {
-                    out << endl << right << setfill('0') << setw(4) << pos << ":";
+        } else {    // 8 bytes a line at their final address
+            size_t pos = se.address;
+            bool advance = se.name != "ABSOLUTE" && se.name != "UNDEFINED";
+            for(size_t i = 0; i < se.data.size(); i++) {
+                if(i % 8 == 0) {
+                    txt << '\n';
+                    txt.hex(pos, 4) << ':';
                 }
-                out << hex << setw(2) << (0xff & dat) << " ";
-                if(se.name != "ABSOLUTE" && se.name != "UNDEFINED") pos++;
+                txt.byte(se.data[i]);
+                if(advance) pos++;
             }
         }
-        out << endl << setfill(' ') << dec << endl;
+        txt << "\n\n";
     }
+    txt.write(out);
 }
 
-void Linker::createBin(ofstream& out) {
-    char mem[1 << 16];  // init mem to zero
-    for(auto& c : mem) {
-        c = 0;
+void Linker::createBin(ostream& out) {
+    size_t imageSize = 1 << 16; // at least the 64KiB address space, more if banks live above it
+    for(auto& seIt : sectionTable) {
+        imageSize = max(imageSize, seIt.second.loadAddress + seIt.second.data.size());
     }
+    vector<char> mem(imageSize, 0);
 
     for(auto& seIt : sectionTable) { // fill mem
-        SectionEntry se = seIt.second;
+        SectionEntry& se = seIt.second;
         if(se.name == "ABSOLUTE" || se.name == "UNDEFINED") continue;
-        int off = 0;
-        for(auto& dat : se.data) {
-            mem[se.address + off++] = dat;
-        }
+        copy(se.data.begin(), se.data.end(), mem.begin() + se.loadAddress);
+    }
+
+    out.write(mem.data(), mem.size());
+}
+
+void Linker::createSegmentedBin(ostream& out) {
+    // "SSEG", segment count, then address, size and data of every placed section.
+    // Nobits sections set zeroFill in the size and have no data.
+    static const uint32_t zeroFill = 1u << 31;
+    vector<SectionEntry*> segments;
+    for(auto& seIt : sectionTable) {
+        SectionEntry& se = seIt.second;
+        if(se.name == "ABSOLUTE" || se.name == "UNDEFINED") continue;
+        if(se.nobits ? se.size == 0 : se.data.empty()) continue;
+        segments.push_back(&se);
     }
 
-    for(auto& c : mem) {
-        out << c;
+    out.write("SSEG", 4);
+    uint32_t count = segments.size();
+    out.write((char*)&count, sizeof(count));
+    for(auto se : segments) {
+        uint32_t address = se->loadAddress;
+        uint32_t size = se->nobits ? se->size | zeroFill : se->data.size();
+        out.write((char*)&address, sizeof(address));
+        out.write((char*)&size, sizeof(size));
+        out.write(se->data.data(), se->data.size());
     }
-}
\ No newline at end of file
+}
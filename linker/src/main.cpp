@@ -2,6 +2,7 @@
 #include <map>
 #include <string>
 #include <regex>
+#include <fstream>
 
 #include "../inc/linker.h"
 
@@ -11,12 +12,18 @@ int main(int argc, const char *argv[])
 {
     string outputFile = "out.o";
     map<string, int> placement;
+    map<string, int> banks;
     bool hexOut = false;
     bool linkableOut = false;
+    bool segmentedOut = false;
+    bool listing = true;
+    bool showStats = false;
+    string statsFile;
     vector<string> inputFiles;
 
     regex placeRx(R"(-place=.+@.+)");
-    regex notSect(R"((-place=)|(@.+))");
+    regex notSect(R"((-place=)|(-bank=)|(@.+))");
+    regex bankRx(R"(-bank=.+@.+)");
     regex notAddr(R"(.+@0x)");
 
     for(int i = 1; i < argc; i++) {
@@ -39,10 +46,33 @@ int main(int argc, const char *argv[])
             placement[section] = address;            
             continue;
         }
+        if(regex_match(arg, bankRx)) {     // physical load address behind the mmu
+            string section = regex_replace(arg, notSect, "");
+            stringstream ss;
+            int address;
+            ss << hex << regex_replace(arg, notAddr, "");
+            ss >> address;
+
+            banks[section] = address;
+            continue;
+        }
         if(arg == "-hex") {
             hexOut = true;
             continue;
         }
+        if(arg == "-segmented") {    // write only the placed sections instead of a 64KiB image
+            segmentedOut = true;
+            continue;
+        }
+        if(arg == "-nolisting") {  // only the binary output
+            listing = false;
+            continue;
+        }
+        if(arg == "-stats" || arg.rfind("-stats=", 0) == 0) {  // time and count the phases
+            showStats = true;
+            if(arg.size() > 6) statsFile = arg.substr(7);
+            continue;
+        }
         if(arg == "-linkable") {
             linkableOut = true;
             continue;
@@ -51,8 +81,28 @@ int main(int argc, const char *argv[])
         inputFiles.push_back(arg);
     }
 
-    Linker linker(outputFile, placement, hexOut, linkableOut, inputFiles);
+    Linker linker(outputFile, placement, hexOut, linkableOut, inputFiles, segmentedOut, banks);
+    linker.setListing(listing);
+    Stats stats;
+    stats.name = outputFile;
+    Stats::counting = showStats;
+    if(showStats) linker.setStats(&stats);
     linker.link();
 
+    if(showStats) {
+        if(statsFile.empty()) {
+            stats.writeText(cout);
+        } else {
+            ofstream out(statsFile, ofstream::out | ofstream::trunc);
+            if(!out.is_open()) {
+                cout << "Couldn't open " << statsFile << "!" << endl;
+                return -1;
+            }
+            out << "{\"tool\":\"linker\",\"runs\":[";
+            stats.writeJson(out);
+            out << "]}" << endl;
+        }
+    }
+
     return 0;
 }
@@ -0,0 +1,51 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <string>
+#include <map>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <iostream>
+#include "../../linker/inc/linker.h"
+
+using namespace std;
+
+class Emulator;
+
+// Assembles, links and loads a program in one process. Objects and the image are
+// handed from stage to stage in memory, files are written only when asked for.
+class Pipeline {
+private:
+    struct Object {
+        string name;    // a.o for a.s
+        string data;    // what the assembler would have written to it
+    };
+
+    ostream& log;
+    vector<Object> objects;
+    Linker linker;
+    string image;
+    bool linked = false;
+    bool optimize = false;
+
+public:
+    Pipeline(map<string, int> placement = {}, bool segmented = false, map<string, int> banks = {}, ostream& log = cout)
+        : log(log), linker("", placement, true, false, {}, segmented, banks) {}
+
+    void setOptimize(bool optimize) { this->optimize = optimize; }
+    // name is what the object would be called, .incbin paths are relative to dir
+    bool assemble(const string& name, istream& source, const string& dir = "");
+    bool assembleFile(const string& file);
+    bool link();
+    bool load(Emulator& emu);
+
+    const string& getImage() { return image; }
+    void writeListing(ostream& out) { linker.writeListing(out); }
+
+    // only these touch the disk
+    bool saveObjects(const string& dir = ".");     // bin_a.o for every a.o
+    bool saveImage(const string& file);
+    bool saveListing(const string& file);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+
+#include "../inc/pipeline.h"
+#include "../../emulator/inc/emulator.h"
+
+using namespace std;
+
+// Assembles and links the sources and runs the result, nothing is written to disk
+// unless -o, -listing or -objects ask for it.
+// pipeline [-place=sec@0xADDR] [-bank=sec@0xPHYS] [-segmented] [-o image] [-listing=file]
+//          [-objects] [-O] [-norun] [-smp=N] [-mem=SIZE] [-idle] [-semihost] a.s b.s ...
+int main(int argc, const char *argv[])
+{
+    map<string, int> placement;
+    map<string, int> banks;
+    bool segmented = false;
+    string imageFile;
+    string listingFile;
+    bool keepObjects = false;
+    bool optimize = false;
+    bool run = true;
+    int cpuCount = 1;
+    size_t memSize = 1 << 16;
+    bool idleDetect = false;
+    bool semihosting = false;
+    vector<string> sources;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if(arg == "-o") {     // also write the image
+            if(++i >= argc) {
+                cout << "Invalid arguments" << endl;
+                return -1;
+            }
+            imageFile = argv[i];
+            continue;
+        }
+        if(arg.rfind("-place=", 0) == 0 || arg.rfind("-bank=", 0) == 0) {   // same as the linker's
+            size_t at = arg.find('@');
+            if(at == string::npos) {
+                cout << "Invalid arguments" << endl;
+                return -1;
+            }
+            size_t eq = arg.find('=');
+            string section = arg.substr(eq + 1, at - eq - 1);
+            int address = stoi(arg.substr(at + 1), nullptr, 16);
+            (arg[1] == 'p' ? placement : banks)[section] = address;
+            continue;
+        }
+        if(arg == "-segmented") {
+            segmented = true;
+            continue;
+        }
+        if(arg.rfind("-listing=", 0) == 0) {  // also write the linker listing
+            listingFile = arg.substr(9);
+            continue;
+        }
+        if(arg == "-objects") {     // also write the objects to the current directory
+            keepObjects = true;
+            continue;
+        }
+        if(arg == "-O") {   // assembler peephole pass
+            optimize = true;
+            continue;
+        }
+        if(arg == "-norun") {   // stop after linking
+            run = false;
+            continue;
+        }
+        if(arg.rfind("-smp=", 0) == 0) {
+            cpuCount = stoi(arg.substr(5));
+            if(cpuCount < 1 || cpuCount > 256) {
+                cout << "Invalid cpu count!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg.rfind("-mem=", 0) == 0) {
+            size_t suffix;
+            memSize = stoul(arg.substr(5), &suffix);
+            string unit = arg.substr(5 + suffix);
+            if(unit == "K") memSize <<= 10;
+            if(unit == "M") memSize <<= 20;
+            if(memSize < 1 << 16 || memSize > (size_t)1 << 28) {
+                cout << "Memory size must be between 64K and 256M!" << endl;
+                return -1;
+            }
+            continue;
+        }
+        if(arg == "-idle") {
+            idleDetect = true;
+            continue;
+        }
+        if(arg == "-semihost") {
+            semihosting = true;
+            continue;
+        }
+        sources.push_back(arg);
+    }
+
+    if(sources.empty()) {
+        cout << "Invalid arguments" << endl;
+        return -1;
+    }
+
+    Pipeline pipeline(placement, segmented, banks);
+    pipeline.setOptimize(optimize);
+    for(const string& source : sources) {
+        if(!pipeline.assembleFile(source)) return -1;
+    }
+    if(keepObjects && !pipeline.saveObjects()) return -1;
+    if(!pipeline.link()) return -1;
+    if(!imageFile.empty() && !pipeline.saveImage(imageFile)) return -1;
+    if(!listingFile.empty() && !pipeline.saveListing(listingFile)) return -1;
+    if(!run) return 0;
+
+    Emulator emu("", cpuCount, idleDetect, memSize);
+    emu.setSemihosting(semihosting);
+    if(!pipeline.load(emu)) return -1;
+    emu.emulate();
+
+    return emu.getExitStatus();
+}
@@ -0,0 +1,92 @@
+#include "../inc/pipeline.h"
+#include "../../assembler/inc/assembler.h"
+#include "../../emulator/inc/emulator.h"
+#include <fstream>
+#include <sstream>
+
+bool Pipeline::assemble(const string& name, istream& source, const string& dir) {
+    for(const Object& object : objects) {   // a.s and lib/a.s would overwrite each other
+        if(object.name == name) {
+            log << name << " is produced by another input too!" << endl;
+            return false;
+        }
+    }
+
+    Assembler assembler("", "", log);
+    assembler.setOptimize(optimize);
+    assembler.setIncludeDir(dir);
+    if(!assembler.assembleSource(source)) return false;
+
+    ostringstream out;
+    assembler.writeObject(out);
+    objects.push_back({name, out.str()});
+    linked = false;
+    return true;
+}
+
+bool Pipeline::assembleFile(const string& file) {
+    ifstream in(file);
+    if(in.fail()) {
+        log << file << " could not be opened!" << endl;
+        return false;
+    }
+    size_t slash = file.find_last_of('/') + 1;
+    string name = file.substr(slash);
+    return assemble(name.substr(0, name.find_last_of('.')) + ".o", in, file.substr(0, slash));
+}
+
+bool Pipeline::link() {
+    linker.reset();
+    for(const Object& object : objects) {
+        istringstream in(object.data);
+        if(!linker.loadObject(in, object.name)) {
+            log << object.name << " is not a valid object file!" << endl;
+            return false;
+        }
+    }
+    if(!linker.build()) return false;
+
+    ostringstream out;
+    linker.writeImage(out);
+    image = out.str();
+    linked = true;
+    return true;
+}
+
+bool Pipeline::load(Emulator& emu) {
+    if(!linked && !link()) return false;
+    return emu.loadImage(image.data(), image.size());
+}
+
+bool Pipeline::saveObjects(const string& dir) {
+    for(const Object& object : objects) {
+        string file = dir + "/bin_" + object.name;   // like the assembler, a.o is its listing
+        ofstream out(file, ios::binary | ios::trunc);
+        if(!out.is_open()) {
+            log << "Couldn't write " << file << "!" << endl;
+            return false;
+        }
+        out << object.data;
+    }
+    return true;
+}
+
+bool Pipeline::saveImage(const string& file) {
+    ofstream out(file, ios::binary | ios::trunc);
+    if(!out.is_open()) {
+        log << "Couldn't open " << file << "!" << endl;
+        return false;
+    }
+    out.write(image.data(), image.size());
+    return true;
+}
+
+bool Pipeline::saveListing(const string& file) {
+    ofstream out(file, ios::trunc);
+    if(!out.is_open()) {
+        log << "Couldn't open " << file << "!" << endl;
+        return false;
+    }
+    writeListing(out);
+    return true;
+}